@@ -0,0 +1,209 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+
+/*
+ * Minimum time a benchmark is measured, in nanoseconds.
+ */
+#define DEFAULT_MIN_TIME 500000000LL
+
+/*
+ * Upper bound of the iterations of a benchmark.
+ */
+#define MAX_ITERATIONS 1000000000LL
+
+#ifdef __GLIBC__
+/*
+ * The allocation functions of the C library are wrapped and counted. Qt
+ * allocates through them as well as operator new does.
+ */
+static quint64 allocations = 0;
+
+extern "C" {
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t nmemb, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+
+  void *malloc(size_t size) __THROW {
+    allocations++;
+    return __libc_malloc(size);
+  }
+
+  void *calloc(size_t nmemb, size_t size) __THROW {
+    allocations++;
+    return __libc_calloc(nmemb, size);
+  }
+
+  void *realloc(void *ptr, size_t size) __THROW {
+    allocations++;
+    return __libc_realloc(ptr, size);
+  }
+}
+
+qint64 qfcgiBenchAllocations() {
+  return allocations;
+}
+#else
+qint64 qfcgiBenchAllocations() {
+  return -1;
+}
+#endif
+
+QFCgiBenchState::QFCgiBenchState(qint64 iterations, qint64 arg) {
+  this->iterations = iterations;
+  this->remaining = iterations;
+  this->arg = arg;
+  this->started = false;
+  this->elapsed = 0;
+  this->allocations = 0;
+  this->bytesProcessed = 0;
+  this->itemsProcessed = 0;
+}
+
+bool QFCgiBenchState::next() {
+  if (!this->started) {
+    // the setup of the benchmark is done, start measuring
+    this->started = true;
+    this->allocations = qfcgiBenchAllocations();
+    this->timer.start();
+  }
+
+  if (this->remaining > 0) {
+    this->remaining--;
+    return true;
+  }
+
+  this->elapsed = this->timer.nsecsElapsed();
+
+  if (this->allocations >= 0) {
+    this->allocations = qfcgiBenchAllocations() - this->allocations;
+  }
+
+  return false;
+}
+
+qint64 QFCgiBenchState::getArg() const {
+  return this->arg;
+}
+
+qint64 QFCgiBenchState::getIterations() const {
+  return this->iterations;
+}
+
+void QFCgiBenchState::setBytesProcessed(qint64 bytes) {
+  this->bytesProcessed = bytes;
+}
+
+qint64 QFCgiBenchState::getBytesProcessed() const {
+  return this->bytesProcessed;
+}
+
+void QFCgiBenchState::setItemsProcessed(qint64 items) {
+  this->itemsProcessed = items;
+}
+
+qint64 QFCgiBenchState::getItemsProcessed() const {
+  return this->itemsProcessed;
+}
+
+qint64 QFCgiBenchState::getElapsed() const {
+  return this->elapsed;
+}
+
+qint64 QFCgiBenchState::getAllocations() const {
+  return this->allocations;
+}
+
+static void report(const QFCgiBenchmark &benchmark, const QFCgiBenchState &state) {
+  double elapsed = qMax(state.getElapsed(), Q_INT64_C(1));
+  char allocs[32] = "n/a";
+  char bytes[32] = "";
+  char items[32] = "";
+
+  if (state.getAllocations() >= 0) {
+    snprintf(allocs, sizeof(allocs), "%.2f", (double)state.getAllocations() / state.getIterations());
+  }
+
+  if (state.getBytesProcessed() > 0) {
+    snprintf(bytes, sizeof(bytes), "%.1f", state.getBytesProcessed() * 1e3 / elapsed);
+  }
+
+  if (state.getItemsProcessed() > 0) {
+    snprintf(items, sizeof(items), "%.0f", state.getItemsProcessed() * 1e9 / elapsed);
+  }
+
+  printf("%-24s %14.1f %12lld %10s %10s %12s\n", benchmark.name,
+         elapsed / state.getIterations(), (long long)state.getIterations(),
+         allocs, bytes, items);
+  fflush(stdout);
+}
+
+static void run(const QFCgiBenchmark &benchmark, qint64 minTime) {
+  qint64 iterations = 1;
+
+  for (;;) {
+    QFCgiBenchState state(iterations, benchmark.arg);
+    benchmark.function(state);
+
+    if (state.getElapsed() >= minTime || iterations >= MAX_ITERATIONS) {
+      report(benchmark, state);
+      return;
+    }
+
+    // aim beyond the minimum time, but grow by 100 at most
+    double factor = (state.getElapsed() > 0) ? minTime * 1.4 / state.getElapsed() : 100;
+    qint64 next = iterations * qMin(factor, 100.0);
+
+    iterations = qBound(iterations + 1, next, MAX_ITERATIONS);
+  }
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-t seconds] [filter]\n", name);
+}
+
+int qfcgiBenchMain(int argc, char *argv[], const QFCgiBenchmark *benchmarks, int count) {
+  qint64 minTime = DEFAULT_MIN_TIME;
+  const char *filter = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      minTime = atof(argv[++i]) * 1e9;
+    } else if (argv[i][0] != '-' && filter == 0) {
+      filter = argv[i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  printf("%-24s %14s %12s %10s %10s %12s\n",
+         "Benchmark", "ns/op", "Iterations", "allocs/op", "MB/s", "items/s");
+
+  for (int i = 0; i < count; i++) {
+    if (filter == 0 || strstr(benchmarks[i].name, filter) != 0) {
+      run(benchmarks[i], minTime);
+    }
+  }
+
+  return 0;
+}
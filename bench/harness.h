@@ -0,0 +1,91 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QFCGI_BENCH_HARNESS_H
+#define QFCGI_BENCH_HARNESS_H
+
+#include <QElapsedTimer>
+#include <QtGlobal>
+
+/*
+ * State of a single benchmark run.
+ *
+ * A benchmark prepares its input, then loops while #keepRunning() returns
+ * true. Only the loop is measured, time and allocations are taken between
+ * the first and the last call of #keepRunning().
+ */
+class QFCgiBenchState {
+public:
+  QFCgiBenchState(qint64 iterations, qint64 arg);
+
+  bool keepRunning() {
+    if (this->remaining > 0 && this->started) {
+      this->remaining--;
+      return true;
+    }
+
+    return next();
+  }
+
+  qint64 getArg() const;
+  qint64 getIterations() const;
+  void setBytesProcessed(qint64 bytes);
+  qint64 getBytesProcessed() const;
+  void setItemsProcessed(qint64 items);
+  qint64 getItemsProcessed() const;
+
+  qint64 getElapsed() const;
+  qint64 getAllocations() const;
+
+private:
+  bool next();
+
+  qint64 iterations;
+  qint64 remaining;
+  qint64 arg;
+  bool started;
+  QElapsedTimer timer;
+  qint64 elapsed;
+  qint64 allocations;
+  qint64 bytesProcessed;
+  qint64 itemsProcessed;
+};
+
+typedef void (*QFCgiBenchFunction)(QFCgiBenchState &state);
+
+/*
+ * A benchmark, the function is run with the given argument.
+ */
+struct QFCgiBenchmark {
+  const char *name;
+  QFCgiBenchFunction function;
+  qint64 arg;
+};
+
+/*
+ * Number of memory allocations of the process so far, or -1 if they are not
+ * counted on this platform.
+ */
+qint64 qfcgiBenchAllocations();
+
+/*
+ * Runs all benchmarks, whose name contains the (optional) filter argument,
+ * and prints time and allocations per operation.
+ */
+int qfcgiBenchMain(int argc, char *argv[], const QFCgiBenchmark *benchmarks, int count);
+
+#endif  /* QFCGI_BENCH_HARNESS_H */
@@ -0,0 +1,566 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QLocalSocket>
+#include <QStringList>
+#include <QTcpSocket>
+#include <QVector>
+#include <qfcgi.h>
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/qfcgi/connection.h"
+#include "../src/qfcgi/record.h"
+#include "../test/nginx_helper.h"
+
+/*
+ * Size of the header the application answers with.
+ */
+static const char responseHeader[] = "Status: 200 OK\r\nContent-Type: text/plain\r\n\r\n";
+
+class QFCgiBenchClient;
+
+/*
+ * Settings of a run, taken from the command line.
+ */
+struct QFCgiBenchOptions {
+  enum Transport {
+    Tcp,
+    Local,
+    SocketPair
+  };
+
+  QFCgiBenchOptions()
+    : transport(Tcp), port(0), connections(1), multiplex(1), requests(10000),
+      keepAlive(false), bodySize(0), responseSize(0), serve(false) {}
+
+  enum Transport transport;
+  QString host;
+  quint16 port;
+  QString path;
+  int connections;
+  int multiplex;
+  qint64 requests;
+  bool keepAlive;
+  qint64 bodySize;
+  qint64 responseSize;
+  bool serve;
+};
+
+/*
+ * Issues the requests to the clients and collects the results.
+ *
+ * With the socketpair transport, or if asked to serve, the application runs
+ * in this process: it drains the input of a request and answers with a body
+ * of the configured size.
+ */
+class QFCgiLoadGenerator : public QObject {
+  Q_OBJECT
+
+public:
+  QFCgiLoadGenerator(const QFCgiBenchOptions &options, QObject *parent = 0);
+
+  const QFCgiBenchOptions& getOptions() const { return this->options; }
+  const QList<QPair<QByteArray, QByteArray> >& getParams() const { return this->params; }
+  const QByteArray& getBody() const { return this->body; }
+
+  bool start();
+  QIODevice* openConnection();
+  qint64 now() const;
+  bool hasRequests() const;
+  bool takeRequest();
+  void requestEnded(qint64 latency, bool failed, qint64 bytesReceived);
+  void abort(const QString &error);
+
+private slots:
+  void onNewRequest(QFCgiRequest *request);
+  void onInput();
+  void onInputFinished();
+
+private:
+  void respond(QFCgiRequest *request);
+  void report();
+
+  QFCgiBenchOptions options;
+  QList<QPair<QByteArray, QByteArray> > params;
+  QByteArray body;
+  QByteArray response;
+  QFCgi *fcgi;
+  QFCgiStats stats;
+  QHash<QObject*, QFCgiRequest*> inputs;
+  QList<QFCgiBenchClient*> clients;
+  QElapsedTimer timer;
+  qint64 issued;
+  qint64 completed;
+  qint64 failed;
+  qint64 bytesReceived;
+  QVector<qint64> latencies;
+  bool aborted;
+};
+
+/*
+ * A connection to the application, which keeps up to multiplex requests in
+ * flight. Without keep-alive every request gets a connection of its own.
+ */
+class QFCgiBenchClient : public QObject {
+  Q_OBJECT
+
+public:
+  QFCgiBenchClient(QFCgiLoadGenerator *generator);
+
+  void start();
+
+private slots:
+  void onConnected();
+  void onReadyRead();
+  void onDisconnected();
+  void onError();
+
+private:
+  void connectDevice();
+  void releaseDevice();
+  void sendRequest(int id);
+  void handleRecord(const QFCgiRecord &record);
+
+  QFCgiLoadGenerator *generator;
+  QIODevice *device;
+  QByteArray input;
+  QHash<int, qint64> requests;
+  QHash<int, qint64> received;
+};
+
+QFCgiLoadGenerator::QFCgiLoadGenerator(const QFCgiBenchOptions &options, QObject *parent) : QObject(parent) {
+  this->options = options;
+  this->params = nginxParams(options.bodySize);
+  this->body = QByteArray(options.bodySize, 'x');
+  this->response = QByteArray(responseHeader).append(QByteArray(options.responseSize, 'x'));
+  this->fcgi = 0;
+  this->issued = 0;
+  this->completed = 0;
+  this->failed = 0;
+  this->bytesReceived = 0;
+  this->aborted = false;
+  this->latencies.reserve(qMin(options.requests, Q_INT64_C(10000000)));
+}
+
+bool QFCgiLoadGenerator::start() {
+  if (this->options.serve || this->options.transport == QFCgiBenchOptions::SocketPair) {
+    this->fcgi = new QFCgi(this);
+    connect(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)), this, SLOT(onNewRequest(QFCgiRequest*)));
+
+    if (this->options.transport == QFCgiBenchOptions::Tcp) {
+      this->fcgi->configureListen(QHostAddress(this->options.host), this->options.port);
+    } else if (this->options.transport == QFCgiBenchOptions::Local) {
+      this->fcgi->configureListen(this->options.path);
+    }
+
+    if (this->options.transport != QFCgiBenchOptions::SocketPair) {
+      this->fcgi->start();
+
+      if (!this->fcgi->isStarted()) {
+        fprintf(stderr, "failed to start the application: %s\n", qPrintable(this->fcgi->errorString()));
+        return false;
+      }
+    }
+  }
+
+  this->timer.start();
+
+  for (int i = 0; i < this->options.connections; i++) {
+    this->clients.append(new QFCgiBenchClient(this));
+    this->clients.last()->start();
+  }
+
+  return true;
+}
+
+QIODevice* QFCgiLoadGenerator::openConnection() {
+  if (this->options.transport == QFCgiBenchOptions::Tcp) {
+    QTcpSocket *so = new QTcpSocket(this);
+    so->connectToHost(this->options.host, this->options.port);
+    return so;
+  } else if (this->options.transport == QFCgiBenchOptions::Local) {
+    QLocalSocket *so = new QLocalSocket(this);
+    so->connectToServer(this->options.path);
+    return so;
+  }
+
+  int sv[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+    abort(QString::fromLocal8Bit(strerror(errno)));
+    return 0;
+  }
+
+  // the other end is served by a connection of the application in this process
+  QLocalSocket *server = new QLocalSocket;
+  server->setSocketDescriptor(sv[1], QLocalSocket::ConnectedState, QIODevice::ReadWrite);
+  new QFCgiConnection(server, this->fcgi, &this->stats, this->fcgi);
+
+  QLocalSocket *so = new QLocalSocket(this);
+  so->setSocketDescriptor(sv[0], QLocalSocket::ConnectedState, QIODevice::ReadWrite);
+  return so;
+}
+
+qint64 QFCgiLoadGenerator::now() const {
+  return this->timer.nsecsElapsed();
+}
+
+bool QFCgiLoadGenerator::hasRequests() const {
+  return this->issued < this->options.requests;
+}
+
+bool QFCgiLoadGenerator::takeRequest() {
+  if (this->issued < this->options.requests) {
+    this->issued++;
+    return true;
+  } else {
+    return false;
+  }
+}
+
+void QFCgiLoadGenerator::requestEnded(qint64 latency, bool failed, qint64 bytesReceived) {
+  if (failed) {
+    this->failed++;
+  } else {
+    this->completed++;
+    this->latencies.append(latency);
+  }
+
+  this->bytesReceived += bytesReceived;
+
+  if (this->completed + this->failed == this->options.requests) {
+    report();
+    QCoreApplication::exit(this->failed > 0 ? 1 : 0);
+  }
+}
+
+void QFCgiLoadGenerator::abort(const QString &error) {
+  if (this->aborted) {
+    return;
+  }
+
+  this->aborted = true;
+  fprintf(stderr, "%s\n", qPrintable(error));
+  QCoreApplication::exit(1);
+}
+
+void QFCgiLoadGenerator::onNewRequest(QFCgiRequest *request) {
+  QIODevice *in = request->getIn();
+
+  if (in->atEnd()) {
+    respond(request);
+  } else {
+    this->inputs[in] = request;
+    connect(in, SIGNAL(readyRead()), this, SLOT(onInput()));
+    connect(in, SIGNAL(readChannelFinished()), this, SLOT(onInputFinished()));
+  }
+}
+
+void QFCgiLoadGenerator::onInput() {
+  QIODevice *in = qobject_cast<QIODevice*>(sender());
+  char data[4096];
+
+  while (in->read(data, sizeof(data)) > 0);
+}
+
+void QFCgiLoadGenerator::onInputFinished() {
+  QIODevice *in = qobject_cast<QIODevice*>(sender());
+  char data[4096];
+
+  while (in->read(data, sizeof(data)) > 0);
+
+  // the request is reused later on, stop listening to its input
+  in->disconnect(this);
+  respond(this->inputs.take(in));
+}
+
+void QFCgiLoadGenerator::respond(QFCgiRequest *request) {
+  request->getOut()->write(this->response);
+  request->endRequest(0);
+}
+
+static double percentile(const QVector<qint64> &sorted, double p) {
+  if (sorted.isEmpty()) {
+    return 0;
+  }
+
+  int idx = qBound(0, (int)(p * sorted.size()), sorted.size() - 1);
+  return sorted.at(idx) / 1e6;
+}
+
+void QFCgiLoadGenerator::report() {
+  double elapsed = qMax(now(), Q_INT64_C(1)) / 1e9;
+  QVector<qint64> sorted = this->latencies;
+  double sum = 0;
+
+  qSort(sorted);
+
+  for (int i = 0; i < sorted.size(); i++) {
+    sum += sorted.at(i);
+  }
+
+  printf("requests:     %lld completed, %lld failed\n", (long long)this->completed, (long long)this->failed);
+  printf("connections:  %d x %d in flight%s\n", this->options.connections, this->options.multiplex,
+         this->options.keepAlive ? ", keep-alive" : "");
+  printf("duration:     %.3f s\n", elapsed);
+  printf("throughput:   %.1f requests/s, %.1f MB/s received\n",
+         this->completed / elapsed, this->bytesReceived / elapsed / 1e6);
+  printf("latency (ms): min %.3f  avg %.3f  p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+         percentile(sorted, 0), sorted.isEmpty() ? 0 : sum / sorted.size() / 1e6,
+         percentile(sorted, 0.5), percentile(sorted, 0.9), percentile(sorted, 0.99),
+         percentile(sorted, 0.999), percentile(sorted, 1));
+  fflush(stdout);
+}
+
+QFCgiBenchClient::QFCgiBenchClient(QFCgiLoadGenerator *generator) : QObject(generator) {
+  this->generator = generator;
+  this->device = 0;
+}
+
+void QFCgiBenchClient::start() {
+  connectDevice();
+}
+
+void QFCgiBenchClient::connectDevice() {
+  this->device = this->generator->openConnection();
+
+  if (this->device == 0) {
+    return;
+  }
+
+  connect(this->device, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+  connect(this->device, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+
+  if (qobject_cast<QTcpSocket*>(this->device) != 0) {
+    connect(this->device, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onError()));
+  } else {
+    connect(this->device, SIGNAL(error(QLocalSocket::LocalSocketError)), this, SLOT(onError()));
+  }
+
+  QTcpSocket *tcpSocket = qobject_cast<QTcpSocket*>(this->device);
+  QLocalSocket *localSocket = qobject_cast<QLocalSocket*>(this->device);
+
+  if ((tcpSocket != 0 && tcpSocket->state() == QAbstractSocket::ConnectedState) ||
+      (localSocket != 0 && localSocket->state() == QLocalSocket::ConnectedState)) {
+    onConnected();
+  } else {
+    connect(this->device, SIGNAL(connected()), this, SLOT(onConnected()));
+  }
+}
+
+void QFCgiBenchClient::releaseDevice() {
+  this->device->disconnect(this);
+  this->device->close();
+  this->device->deleteLater();
+  this->device = 0;
+  this->input.clear();
+}
+
+void QFCgiBenchClient::onConnected() {
+  const QFCgiBenchOptions &options = this->generator->getOptions();
+
+  for (int id = 1; id <= options.multiplex && this->generator->takeRequest(); id++) {
+    sendRequest(id);
+  }
+}
+
+void QFCgiBenchClient::sendRequest(int id) {
+  const QByteArray &body = this->generator->getBody();
+
+  this->requests[id] = this->generator->now();
+  this->received[id] = 0;
+
+  QFCgiRecord::createBeginRequest(id, FCGI_RESPONDER, this->generator->getOptions().keepAlive).write(this->device);
+  QFCgiRecord::createParams(id, this->generator->getParams()).write(this->device);
+  QFCgiRecord::createParams(id, QList<QPair<QByteArray, QByteArray> >()).write(this->device);
+
+  for (int pos = 0; pos < body.size(); pos += MAX_ALIGNED_CONTENT_LENGTH) {
+    QByteArray data = QByteArray::fromRawData(body.constData() + pos, qMin(body.size() - pos, MAX_ALIGNED_CONTENT_LENGTH));
+    QFCgiRecord::createInStream(id, data).write(this->device);
+  }
+
+  QFCgiRecord::createInStream(id, QByteArray()).write(this->device);
+}
+
+void QFCgiBenchClient::onReadyRead() {
+  this->input.append(this->device->readAll());
+
+  QIODevice *device = this->device;
+  qint32 pos = 0;
+
+  // a request might end the connection and another one might be started
+  while (this->device == device) {
+    QFCgiRecord record;
+    qint32 nread = record.read(this->input.constData() + pos, this->input.size() - pos);
+
+    if (nread < 0) {
+      this->generator->abort("invalid record received");
+      return;
+    } else if (nread == 0) {
+      break;
+    }
+
+    pos += nread;
+    handleRecord(record);
+  }
+
+  if (this->device == device) {
+    this->input.remove(0, pos);
+  }
+}
+
+void QFCgiBenchClient::handleRecord(const QFCgiRecord &record) {
+  int id = record.getRequestId();
+
+  if (!this->requests.contains(id)) {
+    this->generator->abort(QString("record for unknown request %1 received").arg(id));
+    return;
+  }
+
+  if (record.getType() == QFCgiRecord::FCGI_STDOUT || record.getType() == QFCgiRecord::FCGI_STDERR) {
+    this->received[id] += record.getContent().size();
+  } else if (record.getType() == QFCgiRecord::FCGI_END_REQUEST) {
+    // a protocol status other than FCGI_REQUEST_COMPLETE is a failure
+    bool failed = record.getContent().size() < 5 || record.getContent().at(4) != QFCgiRecord::FCGI_REQUEST_COMPLETE;
+    qint64 latency = this->generator->now() - this->requests.take(id);
+
+    this->generator->requestEnded(latency, failed, this->received.take(id));
+
+    if (this->generator->getOptions().keepAlive) {
+      if (this->generator->takeRequest()) {
+        sendRequest(id);
+      }
+    } else {
+      // the application closes the connection, start over with a new one
+      releaseDevice();
+
+      if (this->generator->hasRequests()) {
+        connectDevice();
+      }
+    }
+  }
+}
+
+void QFCgiBenchClient::onDisconnected() {
+  this->generator->abort("connection closed by the application");
+}
+
+void QFCgiBenchClient::onError() {
+  this->generator->abort(QString("connection failed: %1").arg(this->device->errorString()));
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options] tcp:<host>:<port> | unix:<path> | socketpair\n"
+          "  -c <n>  number of connections (default 1)\n"
+          "  -m <n>  requests in flight per connection (default 1, needs -k)\n"
+          "  -n <n>  number of requests (default 10000)\n"
+          "  -k      keep the connections alive between requests\n"
+          "  -b <n>  size of the request body in bytes (default 0)\n"
+          "  -o <n>  size of the response body of the application in this process (default 0)\n"
+          "  -s      run the application in this process, implied by socketpair\n",
+          name);
+}
+
+static bool parseTarget(const QString &target, QFCgiBenchOptions &options) {
+  if (target == "socketpair") {
+    options.transport = QFCgiBenchOptions::SocketPair;
+    return true;
+  } else if (target.startsWith("unix:") && target.size() > 5) {
+    options.transport = QFCgiBenchOptions::Local;
+    options.path = target.mid(5);
+    return true;
+  } else if (target.startsWith("tcp:")) {
+    int idx = target.lastIndexOf(':');
+    bool ok;
+
+    options.transport = QFCgiBenchOptions::Tcp;
+    options.host = target.mid(4, idx - 4);
+    options.port = target.mid(idx + 1).toUShort(&ok);
+    return ok && !options.host.isEmpty() && options.port > 0;
+  }
+
+  return false;
+}
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QStringList args = app.arguments();
+  QFCgiBenchOptions options;
+  bool valid = false;
+
+  for (int i = 1; i < args.size(); i++) {
+    const QString &arg = args.at(i);
+    bool ok = true;
+
+    if (arg == "-k") {
+      options.keepAlive = true;
+    } else if (arg == "-s") {
+      options.serve = true;
+    } else if (arg.startsWith("-") && i + 1 < args.size()) {
+      QString value = args.at(++i);
+
+      if (arg == "-c") {
+        options.connections = value.toInt(&ok);
+      } else if (arg == "-m") {
+        options.multiplex = value.toInt(&ok);
+      } else if (arg == "-n") {
+        options.requests = value.toLongLong(&ok);
+      } else if (arg == "-b") {
+        options.bodySize = value.toLongLong(&ok);
+      } else if (arg == "-o") {
+        options.responseSize = value.toLongLong(&ok);
+      } else {
+        ok = false;
+      }
+    } else if (!valid) {
+      ok = valid = parseTarget(arg, options);
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (!valid || options.connections < 1 || options.multiplex < 1 || options.requests < 1 ||
+      options.bodySize < 0 || options.responseSize < 0 || (options.multiplex > 1 && !options.keepAlive)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  QFCgiLoadGenerator generator(options);
+
+  if (!generator.start()) {
+    return 1;
+  }
+
+  return app.exec();
+}
+
+#include "loadgen.moc"
@@ -0,0 +1,236 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QLocalSocket>
+#include <qfcgi.h>
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "harness.h"
+#include "../src/qfcgi/connection.h"
+#include "../src/qfcgi/params.h"
+#include "../src/qfcgi/record.h"
+#include "../src/qfcgi/stream.h"
+#include "../test/nginx_helper.h"
+
+/*
+ * Number of records in the buffer parsed by the record benchmark.
+ */
+#define RECORDS_PER_BUFFER 1024
+
+/*
+ * Size of the reads from the input and of the writes to the output, roughly
+ * what an application does with a QTextStream or QDataStream.
+ */
+#define IO_SIZE 4096
+
+static void appendRecord(QByteArray &ba, const QFCgiRecord &record) {
+  char header[FCGI_HEADER_LEN];
+  quint8 paddingLength = record.encodeHeader(header);
+
+  ba.append(header, FCGI_HEADER_LEN);
+  ba.append(record.getContent());
+  ba.append(QFCgiRecord::getPadding(), paddingLength);
+}
+
+/*
+ * Starts a request on a QFCgiConnection, whose web server end is the given
+ * socket.
+ */
+static QFCgiRequest* beginRequest(QFCgi *fcgi, int fd) {
+  QByteArray ba;
+
+  appendRecord(ba, QFCgiRecord::createBeginRequest(1, FCGI_RESPONDER, true));
+  appendRecord(ba, QFCgiRecord::createParams(1, nginxParams(0)));
+  appendRecord(ba, QFCgiRecord::createParams(1, QList<QPair<QByteArray, QByteArray> >()));
+
+  if (write(fd, ba.constData(), ba.size()) != ba.size()) {
+    qFatal("write: %s", strerror(errno));
+  }
+
+  // the request is a child of the connection
+  for (;;) {
+    QCoreApplication::processEvents();
+    QList<QFCgiRequest*> requests = fcgi->findChildren<QFCgiRequest*>();
+
+    if (!requests.isEmpty()) {
+      return requests.first();
+    }
+  }
+}
+
+/*
+ * Number of bytes of the FCGI_STDOUT records carrying the given content.
+ */
+static qint64 outStreamSize(qint64 size) {
+  qint64 nrecords = (size + MAX_ALIGNED_CONTENT_LENGTH - 1) / MAX_ALIGNED_CONTENT_LENGTH;
+
+  // only the last record is padded
+  return size + nrecords * FCGI_HEADER_LEN + (FCGI_HEADER_LEN - size % FCGI_HEADER_LEN) % FCGI_HEADER_LEN;
+}
+
+/*
+ * Parses FCGI_STDIN records with a content of the given size from a buffer,
+ * one record per operation.
+ */
+static void benchRecordRead(QFCgiBenchState &state) {
+  QByteArray ba;
+  QFCgiRecord record;
+
+  for (int i = 0; i < RECORDS_PER_BUFFER; i++) {
+    appendRecord(ba, QFCgiRecord::createInStream(1, QByteArray(state.getArg(), 'x')));
+  }
+
+  const char *data = ba.constData();
+  qint32 size = ba.size();
+  qint32 pos = 0;
+
+  while (state.keepRunning()) {
+    pos += record.read(data + pos, size - pos);
+
+    if (pos == size) {
+      pos = 0;
+    }
+  }
+
+  state.setItemsProcessed(state.getIterations());
+  state.setBytesProcessed(state.getIterations() * (size / RECORDS_PER_BUFFER));
+}
+
+/*
+ * Decodes the nginx parameter set, looks up a well-known and an arbitrary
+ * parameter and clears the parameters for the next request.
+ */
+static void benchParams(QFCgiBenchState &state) {
+  QByteArray ba = QFCgiRecord::createParams(1, nginxParams(0)).getContent();
+  QFCgiParams params;
+
+  while (state.keepRunning()) {
+    params.consume(ba.constData(), ba.size());
+    params.rawValue(QFCgiRequest::REQUEST_METHOD);
+    params.rawValue("HTTP_SEC_FETCH_MODE", 19);
+    params.clear();
+  }
+
+  state.setItemsProcessed(state.getIterations());
+  state.setBytesProcessed(state.getIterations() * ba.size());
+}
+
+/*
+ * Receives a body of the given size through the input stream of a request,
+ * record by record, and reads it as the application does.
+ */
+static void benchStdin(QFCgiBenchState &state) {
+  QByteArray body(state.getArg(), 'x');
+  QFCgiStream stream;
+  char data[IO_SIZE];
+
+  while (state.keepRunning()) {
+    stream.reopen(QIODevice::ReadOnly);
+
+    for (int pos = 0; pos < body.size(); pos += MAX_ALIGNED_CONTENT_LENGTH) {
+      int length = qMin(body.size() - pos, MAX_ALIGNED_CONTENT_LENGTH);
+
+      stream.append(QByteArray::fromRawData(body.constData() + pos, length));
+      while (stream.read(data, sizeof(data)) > 0);
+    }
+
+    stream.setEof();
+    while (stream.read(data, sizeof(data)) > 0);
+  }
+
+  state.setItemsProcessed(state.getIterations());
+  state.setBytesProcessed(state.getIterations() * body.size());
+}
+
+/*
+ * Writes a body of the given size into the output stream of a request and
+ * flushes it. The request is served by a QFCgiConnection over a socketpair,
+ * the records are read from the other end. The socket I/O is measured as
+ * well.
+ */
+static void benchStdout(QFCgiBenchState &state) {
+  QByteArray data(IO_SIZE, 'x');
+  qint64 size = outStreamSize(state.getArg());
+  char buf[65536];
+  QFCgiStats stats; // outlives the connection
+  QFCgi fcgi;
+  int sv[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+    qFatal("socketpair: %s", strerror(errno));
+  }
+
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+
+  QLocalSocket *server = new QLocalSocket;
+  server->setSocketDescriptor(sv[1], QLocalSocket::ConnectedState, QIODevice::ReadWrite);
+  new QFCgiConnection(server, &fcgi, &stats, &fcgi);
+
+  QFCgiRequest *request = beginRequest(&fcgi, sv[0]);
+  request->setOutputPolicy(QFCgiRequest::FlushOnEnd);
+
+  while (state.keepRunning()) {
+    for (qint64 nwritten = 0; nwritten < state.getArg(); nwritten += IO_SIZE) {
+      request->getOut()->write(data.constData(), qMin(state.getArg() - nwritten, (qint64)IO_SIZE));
+    }
+
+    request->flush();
+
+    for (qint64 nread = 0; nread < size; ) {
+      ssize_t n = read(sv[0], buf, sizeof(buf));
+
+      if (n > 0) {
+        nread += n;
+      } else {
+        // the connection writes, when control returns to the event loop
+        QCoreApplication::processEvents();
+      }
+    }
+  }
+
+  ::close(sv[0]);
+
+  state.setItemsProcessed(state.getIterations());
+  state.setBytesProcessed(state.getIterations() * state.getArg());
+}
+
+static const QFCgiBenchmark benchmarks[] = {
+  { "record_read/8", benchRecordRead, 8 },
+  { "record_read/1k", benchRecordRead, 1024 },
+  { "record_read/64k", benchRecordRead, MAX_ALIGNED_CONTENT_LENGTH },
+  { "params/nginx", benchParams, 0 },
+  { "stdin/1k", benchStdin, 1024 },
+  { "stdin/64k", benchStdin, 64 * 1024 },
+  { "stdin/1m", benchStdin, 1024 * 1024 },
+  { "stdin/100m", benchStdin, 100 * 1024 * 1024 },
+  { "stdout/1k", benchStdout, 1024 },
+  { "stdout/64k", benchStdout, 64 * 1024 },
+  { "stdout/1m", benchStdout, 1024 * 1024 }
+};
+
+int main(int argc, char *argv[]) {
+  // the output benchmark runs a connection
+  QCoreApplication app(argc, argv);
+
+  return qfcgiBenchMain(argc, argv, benchmarks, sizeof(benchmarks) / sizeof(benchmarks[0]));
+}
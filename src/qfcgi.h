@@ -20,5 +20,6 @@
 
 #include "qfcgi/fcgi.h"
 #include "qfcgi/request.h"
+#include "qfcgi/stats.h"
 
 #endif  /* QFCGI_H */
@@ -0,0 +1,96 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "arena.h"
+
+QFCgiArena::QFCgiArena(int blockSize, int maxBlockSize) {
+  this->blockSize = blockSize;
+  this->maxBlockSize = qMax(blockSize, maxBlockSize);
+  this->nextBlockSize = blockSize;
+  this->offset = 0;
+  this->allocations = 0;
+}
+
+QFCgiArena::~QFCgiArena() {
+  for (int i = 0; i < this->blocks.size(); i++) {
+    free(this->blocks.at(i).data);
+  }
+}
+
+char* QFCgiArena::allocate(int size) {
+  if (!this->blocks.isEmpty() && this->offset + size <= this->blocks.last().size) {
+    char *data = this->blocks.last().data + this->offset;
+    this->offset += size;
+    return data;
+  }
+
+  // the rest of the current block is wasted, it is reclaimed by reset()
+  Block block;
+  block.size = qMax(size, this->nextBlockSize);
+  block.data = (char*)malloc(block.size);
+
+  if (block.data == 0) {
+    qFatal("out of memory (%d bytes)", block.size);
+  }
+
+  this->blocks.append(block);
+  this->offset = size;
+  this->allocations++;
+  this->nextBlockSize = qMin(this->nextBlockSize * 2, this->maxBlockSize);
+
+  return block.data;
+}
+
+void QFCgiArena::reset() {
+  // a small first block is kept for the next round, a large one is not
+  int keep = (!this->blocks.isEmpty() && this->blocks.first().size <= this->blockSize) ? 1 : 0;
+
+  for (int i = keep; i < this->blocks.size(); i++) {
+    free(this->blocks.at(i).data);
+  }
+
+  this->blocks.resize(keep);
+  this->nextBlockSize = (keep > 0) ? qMin(this->blockSize * 2, this->maxBlockSize) : this->blockSize;
+  this->offset = 0;
+}
+
+void QFCgiArena::release(const char *data) {
+  int n = 0;
+
+  // the current block is never released
+  while (n < this->blocks.size() - 1) {
+    const Block &block = this->blocks.at(n);
+
+    if (data >= block.data && data < block.data + block.size) {
+      break;
+    }
+
+    n++;
+  }
+
+  for (int i = 0; i < n; i++) {
+    free(this->blocks.at(i).data);
+  }
+
+  this->blocks.remove(0, n);
+}
+
+int QFCgiArena::getAllocationCount() const {
+  return this->allocations;
+}
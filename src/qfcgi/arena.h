@@ -0,0 +1,64 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QFCGI_ARENA_H
+#define QFCGI_ARENA_H
+
+#include <QVector>
+
+/*
+ * Bump allocator for request-scoped raw bytes.
+ *
+ * Memory is carved from blocks and released all at once with #reset()
+ * instead of piece by piece. Every block doubles the size of the previous one
+ * up to the maximum block size. The first block survives the reset, as long
+ * as it has the initial size, thus an arena reused for the next request
+ * usually allocates nothing at all. An allocation larger than the block size
+ * gets a block of its own. Blocks in
+ * front of the oldest allocation still in use are freed with #release().
+ *
+ * #getAllocationCount() counts the blocks allocated from the heap over the
+ * lifetime of the arena.
+ */
+class QFCgiArena {
+public:
+  QFCgiArena(int blockSize, int maxBlockSize = 0);
+  ~QFCgiArena();
+
+  char* allocate(int size);
+  void reset();
+  void release(const char *data);
+
+  int getAllocationCount() const;
+
+private:
+  Q_DISABLE_COPY(QFCgiArena)
+
+  struct Block {
+    char *data;
+    int size;
+  };
+
+  QVector<Block> blocks;
+  int blockSize;
+  int maxBlockSize;
+  int nextBlockSize;
+  int offset;
+  int allocations;
+};
+
+#endif  /* QFCGI_ARENA_H */
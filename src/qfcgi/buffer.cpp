@@ -0,0 +1,86 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "buffer.h"
+
+QFCgiBuffer::QFCgiBuffer() {
+  this->begin = 0;
+  this->end = 0;
+}
+
+const char* QFCgiBuffer::data() const {
+  return this->storage.constData() + this->begin;
+}
+
+int QFCgiBuffer::size() const {
+  return this->end - this->begin;
+}
+
+bool QFCgiBuffer::isEmpty() const {
+  return this->begin == this->end;
+}
+
+void QFCgiBuffer::append(const char *data, int size) {
+  makeRoom(size);
+  memcpy(this->storage.data() + this->end, data, size);
+  this->end += size;
+}
+
+char* QFCgiBuffer::reserve(int nbytes) {
+  makeRoom(nbytes);
+  return this->storage.data() + this->end;
+}
+
+void QFCgiBuffer::commit(int nbytes) {
+  this->end = qMin(this->end + nbytes, this->storage.size());
+}
+
+void QFCgiBuffer::consume(int nbytes) {
+  this->begin += qMin(nbytes, size());
+
+  if (this->begin == this->end) {
+    // everything consumed, rewind without touching the storage
+    this->begin = 0;
+    this->end = 0;
+  }
+}
+
+void QFCgiBuffer::clear() {
+  this->begin = 0;
+  this->end = 0;
+}
+
+void QFCgiBuffer::makeRoom(int nbytes) {
+  if (this->end + nbytes <= this->storage.size()) {
+    return;
+  }
+
+  if (this->begin > 0) {
+    // move the unread bytes to the front, this happens once per fill and not
+    // once per consumed record
+    int len = size();
+    memmove(this->storage.data(), this->storage.constData() + this->begin, len);
+    this->begin = 0;
+    this->end = len;
+  }
+
+  if (this->end + nbytes > this->storage.size()) {
+    this->storage.resize(qMax(this->storage.size() * 2, this->end + nbytes));
+  }
+}
@@ -0,0 +1,56 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QFCGI_BUFFER_H
+#define QFCGI_BUFFER_H
+
+#include <QByteArray>
+
+/*
+ * Input buffer with a read cursor.
+ *
+ * Consumed bytes are dropped by advancing the cursor. The unread bytes are
+ * moved to the front of the storage only when new data does not fit behind
+ * them, so parsing many small records out of one read costs no memmove per
+ * record.
+ *
+ * To fill the buffer without an intermediate copy, #reserve() space at the
+ * end, write into it and #commit() the number of bytes actually written.
+ */
+class QFCgiBuffer {
+public:
+  QFCgiBuffer();
+
+  const char* data() const;
+  int size() const;
+  bool isEmpty() const;
+
+  void append(const char *data, int size);
+  char* reserve(int nbytes);
+  void commit(int nbytes);
+  void consume(int nbytes);
+  void clear();
+
+private:
+  void makeRoom(int nbytes);
+
+  QByteArray storage;
+  int begin;
+  int end;
+};
+
+#endif  /* QFCGI_BUFFER_H */
@@ -0,0 +1,113 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QSocketNotifier>
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "builder.h"
+
+static int acceptSocket(int listenSocket) {
+#if defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+  return accept4(listenSocket, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+  int so = accept(listenSocket, 0, 0);
+
+  if (so != -1) {
+    fcntl(so, F_SETFD, FD_CLOEXEC);
+    fcntl(so, F_SETFL, fcntl(so, F_GETFL) | O_NONBLOCK);
+  }
+
+  return so;
+#endif
+}
+
+QFCgiConnectionBuilder::QFCgiConnectionBuilder(QObject *parent) : QObject(parent) {
+  this->notifier = 0;
+  this->listenSocket = -1;
+  this->ownsSocket = false;
+  this->acceptBudget = 64;
+}
+
+QFCgiConnectionBuilder::~QFCgiConnectionBuilder() {
+  close();
+}
+
+void QFCgiConnectionBuilder::close() {
+  delete this->notifier;
+  this->notifier = 0;
+
+  if (this->ownsSocket && this->listenSocket != -1) {
+    ::close(this->listenSocket);
+  }
+
+  this->listenSocket = -1;
+}
+
+bool QFCgiConnectionBuilder::isListening() const {
+  return (this->notifier != 0);
+}
+
+QString QFCgiConnectionBuilder::errorString() const {
+  return this->error;
+}
+
+int QFCgiConnectionBuilder::getAcceptBudget() const {
+  return this->acceptBudget;
+}
+
+void QFCgiConnectionBuilder::setAcceptBudget(int budget) {
+  this->acceptBudget = qMax(budget, 1);
+}
+
+void QFCgiConnectionBuilder::startAccepting(int listenSocket, bool ownsSocket) {
+  // accept() returns EAGAIN instead of blocking, when the queue is drained
+  fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL) | O_NONBLOCK);
+
+  this->listenSocket = listenSocket;
+  this->ownsSocket = ownsSocket;
+  this->notifier = new QSocketNotifier(listenSocket, QSocketNotifier::Read, this);
+  connect(this->notifier, SIGNAL(activated(int)), this, SLOT(onActivated(int)));
+}
+
+void QFCgiConnectionBuilder::setErrorString(const QString &error) {
+  this->error = error;
+}
+
+void QFCgiConnectionBuilder::onActivated(int socket) {
+  // Drain the accept queue, but not forever. Connections left over are
+  // accepted with the next wakeup, others get their turn in between.
+  for (int naccepted = 0; naccepted < this->acceptBudget; ) {
+    int so = acceptSocket(socket);
+
+    if (so != -1) {
+      naccepted++;
+      emit newConnection(so);
+    } else if (errno == EINTR || errno == ECONNABORTED) {
+      continue;
+    } else {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        qDebug("accept: %s", strerror(errno));
+      }
+      break;
+    }
+  }
+}
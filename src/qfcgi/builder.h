@@ -19,22 +19,60 @@
 #define QFCGI_BUILDER_H
 
 #include <QObject>
+#include <QString>
 
-class QFCgiConnection;
+class QSocketNotifier;
 
+/*
+ * Accepts connections and hands over the descriptors of the accepted sockets.
+ * The QFCgiConnection is created by the worker serving the socket.
+ *
+ * Subclasses create the listening socket and pass it to #startAccepting().
+ * Every wakeup accepts up to the accept-budget connections at once.
+ */
 class QFCgiConnectionBuilder : public QObject {
   Q_OBJECT
 
 public:
-  QFCgiConnectionBuilder(QObject *parent = 0) : QObject(parent) {}
-  virtual ~QFCgiConnectionBuilder() {}
+  enum SocketType {
+    TcpSocket,
+    LocalSocket
+  };
+
+  QFCgiConnectionBuilder(QObject *parent = 0);
+  virtual ~QFCgiConnectionBuilder();
 
   virtual bool listen() = 0;
-  virtual bool isListening() const = 0;
-  virtual QString errorString() const = 0;
+  virtual void close();
+  virtual bool isListening() const;
+  virtual QString errorString() const;
+  virtual SocketType getSocketType() const = 0;
+
+  /*
+   * Returns a new builder listening on its own, which runs on a worker
+   * thread, or 0 if all workers are served by this builder.
+   */
+  virtual QFCgiConnectionBuilder* createWorkerBuilder() const { return 0; }
+
+  int getAcceptBudget() const;
+  void setAcceptBudget(int budget);
 
 signals:
-  void newConnection(QFCgiConnection *connection);
+  void newConnection(int descriptor);
+
+protected:
+  void startAccepting(int listenSocket, bool ownsSocket);
+  void setErrorString(const QString &error);
+
+private slots:
+  void onActivated(int socket);
+
+private:
+  QSocketNotifier *notifier;
+  int listenSocket;
+  bool ownsSocket;
+  int acceptBudget;
+  QString error;
 };
 
 #endif  /* QFCGI_BUILDER_H */
@@ -15,40 +15,109 @@
  * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <QAbstractSocket>
+#include <QLocalSocket>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#endif
+
 #include "connection.h"
 #include "fcgi.h"
+#include "params.h"
 #include "record.h"
 #include "request.h"
+#include "stats.h"
 #include "stream.h"
+#include "trace.h"
 
 #define q1Debug(format, args...) qDebug("[%d] " format, this->id, ##args)
 #define q2Debug(record, format, args...) qDebug("[%d,%d] " format, this->id, record.getRequestId(), ##args)
 
 /*
- * Values for role component of FCGI_BeginRequestBody
+ * Contents smaller than this are copied into the output buffer, larger ones
+ * are queued as a segment of their own.
+ */
+#define MIN_SEGMENT_SIZE 512
+
+/*
+ * Maximum number of segments passed to a single sendmsg() invocation.
+ */
+#define MAX_SEGMENTS 64
+
+/*
+ * Maximum number of ended requests kept by a connection for reuse.
  */
-#define FCGI_RESPONDER  1
-#define FCGI_AUTHORIZER 2
-#define FCGI_FILTER     3
+#define MAX_FREE_REQUESTS 8
 
 /*
- * Mask for flags component of FCGI_BeginRequestBody
+ * Number of output-quanta a request moves per round, when it is alone on its
+ * connection. A request started later waits for a bounded amount of output.
  */
-#define FCGI_KEEP_CONN  1
+#define ALONE_QUANTA 16
 
-static int nextConnectionId = 0;
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
-QFCgiConnection::QFCgiConnection(QIODevice *device, QFCgi *parent) : QObject(parent) {
-  this->id = ++nextConnectionId;
+static QAtomicInt nextConnectionId(0);
+
+QFCgiConnection::QFCgiConnection(QIODevice *device, QFCgi *fcgi, QFCgiStats *stats, QObject *parent) : QObject(parent) {
+  this->id = nextConnectionId.fetchAndAddRelaxed(1) + 1;
+  this->fcgi = fcgi;
+  this->stats = stats;
+  this->stats->acceptedConnections++;
   this->device = device;
   this->device->setParent(this); /* Take over ownership of the device.
                                     You it is safe to destroy the object here. */
+  this->paused = false;
+  this->draining = false;
+  this->blocked = false;
+  this->descriptor = -1;
+  this->outputOffset = 0;
+  this->outputTail = false;
+  this->flushScheduled = false;
+  this->activeRequests = 0;
+  this->abortedRequests = 0;
+  this->pendingInput = 0;
+
+  // Bound the read buffer of the socket as well, otherwise the socket keeps
+  // reading from the kernel while the connection is paused.
+  QAbstractSocket *tcpSocket = qobject_cast<QAbstractSocket*>(device);
+  QLocalSocket *localSocket = qobject_cast<QLocalSocket*>(device);
+
+  if (tcpSocket != 0) {
+    tcpSocket->setReadBufferSize(this->fcgi->getReadChunkSize());
+    this->descriptor = tcpSocket->socketDescriptor();
+  } else if (localSocket != 0) {
+    localSocket->setReadBufferSize(this->fcgi->getReadChunkSize());
+    this->descriptor = localSocket->socketDescriptor();
+  }
 
   connect(this->device, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+  connect(this->device, SIGNAL(bytesWritten(qint64)), this, SLOT(onBytesWritten()));
   connect(this->device, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+
+  QFCGI_TRACE_CONNECTION_ACCEPT(this->id, this->descriptor);
 }
 
 QFCgiConnection::~QFCgiConnection() {
+  // requests, which were not ended, are released with the connection
+  for (int i = 0; i < this->activeRequests; i++) {
+    this->fcgi->releaseRequest();
+  }
+
+  this->fcgi->updatePendingInput(-this->pendingInput);
+  this->stats->closedConnections++;
+  QFCGI_TRACE_CONNECTION_CLOSE(this->id);
+
+  discardOutput();
   delete this->device;
 }
 
@@ -57,32 +126,258 @@ int QFCgiConnection::getId() const {
 }
 
 void QFCgiConnection::send(const QFCgiRecord &record) {
+  OutputRecord output;
+
+  output.paddingLength = record.encodeHeader(output.header);
+  output.content = OutputSegment(record.getContent());
+
   q2Debug(record, "sending record [type: %d, content-length: %d]", record.getType(), record.getContent().size());
-  record.write(this->device);
+
+  enqueueRecord(record.getRequestId(), output);
+  scheduleFlush();
+}
+
+bool QFCgiConnection::sendFile(quint16 requestId, int fd, qint64 offset, qint64 length) {
+  if (length <= 0) {
+    return true;
+  }
+
+  // the segments own a descriptor of their own, the caller keeps fd
+#ifdef F_DUPFD_CLOEXEC
+  int segmentFd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+#else
+  int segmentFd = dup(fd);
+
+  if (segmentFd != -1) {
+    fcntl(segmentFd, F_SETFD, FD_CLOEXEC);
+  }
+#endif
+
+  if (segmentFd == -1) {
+    q1Debug("dup: %s", strerror(errno));
+    return false;
+  }
+
+  QFCgiRecord record;
+  record.setType(QFCgiRecord::FCGI_STDOUT);
+  record.setRequestId(requestId);
+
+  while (length > 0) {
+    quint16 contentLength = qMin(length, (qint64)MAX_ALIGNED_CONTENT_LENGTH);
+    OutputRecord output;
+
+    output.paddingLength = record.encodeHeader(output.header, contentLength);
+    output.content = OutputSegment(segmentFd, offset, contentLength);
+    this->outputFiles[segmentFd]++;
+    enqueueRecord(requestId, output);
+
+    offset += contentLength;
+    length -= contentLength;
+  }
+
+  q1Debug("sending file [request-id: %d, segments: %d]", requestId, this->outputFiles.value(segmentFd));
+  scheduleFlush();
+
+  return true;
+}
+
+void QFCgiConnection::scheduleFlush() {
+  if (!this->flushScheduled) {
+    // the whole batch is written, when control returns to the event loop
+    this->flushScheduled = true;
+    QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+  }
 }
 
 void QFCgiConnection::closeConnection() {
+  if (!this->device->isOpen()) {
+    return;
+  }
+
+  flush();
+
+  // everything still queued goes through the device, which sends it before
+  // the connection is closed
+  while (scheduleOutput() && writeOutputSegment()) {
+  }
+
   this->device->close();
 }
 
-void QFCgiConnection::onReadyRead() {
-  fillBuffer();
+void QFCgiConnection::drain() {
+  this->draining = true;
 
-  QFCgiRecord record;
-  qint32 nconsumed;
+  if (this->activeRequests == 0 && this->abortedRequests == 0) {
+    q1Debug("closing idle connection");
+    closeConnection();
+  }
+}
 
-  while ((nconsumed = record.read(this->buf)) > 0) {
-    this->buf.remove(0, nconsumed);
+void QFCgiConnection::requestEnded(QFCgiRequest *request) {
+  qint64 now = QFCgiStats::now();
 
-    switch (record.getRequestId()) {
-      case 0:  handleManagementRecord(record); break;
-      default: handleApplicationRecord(record); break;
+  // the request-id is free for the next request of the web server
+  this->requests.remove(request->getId());
+  QFCGI_TRACE_REQUEST_END(this->id, request->getId(), request->isAborted());
+
+  if (request->paramsTime != 0) {
+    // the request was started, see handleFCGI_PARAMS()
+    this->stats->completedRequests++;
+    this->stats->addLatency(QFCgiStats::ResponseLatency, now - request->paramsTime);
+    this->stats->addLatency(QFCgiStats::TotalLatency, now - request->beginTime);
+  }
+
+  if (!request->in->isEof()) {
+    // input-records of the request, which are still on their way, are skipped
+    this->rejectedRequests.insert(request->getId());
+  }
+
+  this->activeRequests--;
+  this->fcgi->releaseRequest();
+
+  // the input of the request was discarded
+  updatePendingInput();
+
+  if (!request->abortEnded) {
+    recycleRequest(request);
+  } else {
+    // the application still holds the request, see releaseAbortedRequest()
+    this->abortedRequests++;
+  }
+
+  if (this->draining && this->activeRequests == 0 && this->abortedRequests == 0) {
+    // the ended request is sent before the connection is closed
+    closeConnection();
+  }
+}
+
+void QFCgiConnection::releaseAbortedRequest(QFCgiRequest *request) {
+  this->abortedRequests--;
+  recycleRequest(request);
+
+  // the connection was kept open for the application, see
+  // QFCgiRequest::endRequest()
+  if (!request->keepConnection() || (this->draining && this->activeRequests == 0 && this->abortedRequests == 0)) {
+    q1Debug("aborted request released, about to close connection");
+    closeConnection();
+  }
+}
+
+void QFCgiConnection::recycleRequest(QFCgiRequest *request) {
+  // The application might still use the request, until control returns to
+  // the event loop.
+  if (this->endedRequests.isEmpty()) {
+    QMetaObject::invokeMethod(this, "recycleRequests", Qt::QueuedConnection);
+  }
+
+  this->endedRequests.append(request);
+}
+
+void QFCgiConnection::recycleRequests() {
+  while (!this->endedRequests.isEmpty()) {
+    QFCgiRequest *request = this->endedRequests.takeFirst();
+
+    if (this->freeRequests.size() < MAX_FREE_REQUESTS) {
+      this->freeRequests.append(request);
+    } else {
+      delete request;
     }
   }
+}
+
+void QFCgiConnection::flush() {
+  this->flushScheduled = false;
+
+  if (this->device->bytesToWrite() > 0) {
+    // The device still has buffered data, continue when they are written
+    // (onBytesWritten()), otherwise the order of the output is lost.
+    return;
+  }
+
+  if (this->descriptor == -1) {
+    while (scheduleOutput() && writeOutputSegment()) {
+    }
+    return;
+  }
+
+  while (scheduleOutput()) {
+    if (this->output.first().fd != -1) {
+      if (!sendFileSegment()) {
+        return;
+      }
+      continue;
+    }
+
+    struct iovec iov[MAX_SEGMENTS];
+    struct msghdr msg;
+    int niov = 0;
+    ssize_t total = 0;
+
+    // gather the data-segments in front of the next file-segment
+    while (niov < this->output.size() && niov < MAX_SEGMENTS && this->output.at(niov).fd == -1) {
+      const QByteArray &segment = this->output.at(niov).data;
+      int offset = (niov == 0) ? this->outputOffset : 0;
+
+      iov[niov].iov_base = (void*)(segment.constData() + offset);
+      iov[niov].iov_len = segment.size() - offset;
+      total += iov[niov].iov_len;
+      niov++;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = niov;
+
+    ssize_t nwritten = sendmsg(this->descriptor, &msg, MSG_NOSIGNAL);
+
+    if (nwritten < 0 && errno == EINTR) {
+      continue;
+    } else if (nwritten < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      q1Debug("sendmsg: %s", strerror(errno));
+      discardOutput();
+      deleteLater();
+      return;
+    }
+
+    consumeOutput(qMax(nwritten, (ssize_t)0));
+    this->stats->bytesOut += qMax(nwritten, (ssize_t)0);
+
+    if (nwritten < total) {
+      // The socket is full, the device buffers the rest of the current
+      // segment and notifies (onBytesWritten()) when it is able to write
+      // again.
+      writeOutputSegment();
+      return;
+    }
+  }
+}
+
+void QFCgiConnection::onBytesWritten() {
+  bool pending = !this->output.isEmpty() || !this->outputSchedule.isEmpty();
+
+  if (pending && this->device->bytesToWrite() == 0) {
+    flush();
+  }
+}
 
-  if (nconsumed < 0) {
+void QFCgiConnection::onReadyRead() {
+  qint64 nread;
+
+  // records left over from a pause are processed first
+  if (!processBuffer()) {
     q1Debug("failed to read record");
+    this->stats->parseErrors++;
     deleteLater();
+    return;
+  }
+
+  while (!isPaused() && (nread = fillBuffer()) > 0) {
+    if (!processBuffer()) {
+      q1Debug("failed to read record");
+      this->stats->parseErrors++;
+      deleteLater();
+      return;
+    }
   }
 }
 
@@ -91,28 +386,413 @@ void QFCgiConnection::onDisconnected() {
   deleteLater();
 }
 
-void QFCgiConnection::fillBuffer() {
-  qint64 avail = this->device->bytesAvailable();
-  char buf[avail];
+void QFCgiConnection::onInputConsumed() {
+  updatePendingInput();
 
-  qint64 nread = this->device->read(buf, avail);
+  if (this->blocked) {
+    // the blocked request might have room again, check it with the next read
+    this->blocked = false;
+  }
+
+  if (this->paused && !isPaused()) {
+    // continue reading, when control returns to the event loop
+    QMetaObject::invokeMethod(this, "onReadyRead", Qt::QueuedConnection);
+  }
+}
+
+qint64 QFCgiConnection::fillBuffer() {
+  qint64 avail = qMin(this->device->bytesAvailable(), (qint64)this->fcgi->getReadChunkSize());
+
+  if (avail <= 0) {
+    return 0;
+  }
+
+  // read straight into the input buffer
+  qint64 nread = this->device->read(this->buf.reserve(avail), avail);
 
   if (nread >= 0) {
     q1Debug("%lli bytes read from socket", nread);
-    this->buf.append(buf, nread);
+    this->buf.commit(nread);
+    this->stats->bytesIn += nread;
   } else {
     q1Debug("%s", qPrintable(this->device->errorString()));
     deleteLater();
   }
+
+  return nread;
+}
+
+bool QFCgiConnection::processBuffer() {
+  QFCgiRecord record;
+  qint32 nconsumed;
+
+  // The content of the record refers to the input buffer, it is valid until
+  // the buffer is filled again.
+  this->blocked = false;
+
+  while ((nconsumed = record.read(this->buf.data(), this->buf.size())) > 0) {
+    if (isBlocked(record)) {
+      // leave the record in the buffer until the request has room for it
+      this->blocked = true;
+      break;
+    }
+
+    this->buf.consume(nconsumed);
+    this->stats->records[record.getType()]++;
+    QFCGI_TRACE_RECORD_PARSED(this->id, record.getRequestId(), record.getType(), record.getContent().size());
+
+    switch (record.getRequestId()) {
+      case 0:  handleManagementRecord(record); break;
+      default: handleApplicationRecord(record); break;
+    }
+  }
+
+  // a blocked record is read again, once the request has room for it
+  return (nconsumed == 0 || this->blocked);
+}
+
+void QFCgiConnection::enqueueRecord(quint16 requestId, const OutputRecord &record) {
+  if (requestId == 0) {
+    // management records are not scheduled
+    appendRecord(record);
+    return;
+  }
+
+  if (!this->outputQueues.contains(requestId)) {
+    // the request takes its turn after the ones already waiting
+    this->outputSchedule.append(requestId);
+  }
+
+  this->outputQueues[requestId].append(record);
+}
+
+void QFCgiConnection::appendRecord(const OutputRecord &record) {
+  const OutputSegment &content = record.content;
+
+  QFCGI_TRACE_RECORD_SENT(this->id,
+    ((record.header[2] & 0xFF) << 8) | (record.header[3] & 0xFF),
+    record.header[1],
+    content.length);
+
+  appendOutput(record.header, FCGI_HEADER_LEN);
+
+  if (content.fd != -1 || content.length >= MIN_SEGMENT_SIZE) {
+    this->output.append(content);
+    this->outputTail = false;
+  } else {
+    appendOutput(content.data.constData(), content.data.size());
+  }
+
+  appendOutput(QFCgiRecord::getPadding(), record.paddingLength);
+}
+
+bool QFCgiConnection::scheduleOutput() {
+  if (!this->output.isEmpty()) {
+    return true;
+  }
+
+  // Every request moves a quantum of its records per round, a single request
+  // several of them. A large response delays the others by a quantum instead
+  // of its whole size.
+  qint64 quantum = this->fcgi->getOutputQuantum();
+  if (this->outputSchedule.size() == 1) {
+    quantum *= ALONE_QUANTA;
+  }
+  int count = this->outputSchedule.size();
+
+  for (int i = 0; i < count; i++) {
+    int requestId = this->outputSchedule.takeFirst();
+    QList<OutputRecord> &queue = this->outputQueues[requestId];
+    qint64 nbytes = 0;
+
+    while (!queue.isEmpty() && nbytes < quantum) {
+      const OutputRecord &record = queue.first();
+
+      nbytes += FCGI_HEADER_LEN + record.content.length + record.paddingLength;
+      appendRecord(record);
+      queue.removeFirst();
+    }
+
+    if (queue.isEmpty()) {
+      this->outputQueues.remove(requestId);
+    } else {
+      this->outputSchedule.append(requestId);
+    }
+  }
+
+  return !this->output.isEmpty();
+}
+
+void QFCgiConnection::appendOutput(const char *data, int size) {
+  if (size == 0) {
+    return;
+  }
+
+  if (!this->outputTail) {
+    this->output.append(OutputSegment());
+    this->outputTail = true;
+  }
+
+  this->output.last().data.append(data, size);
+  this->output.last().length += size;
+}
+
+void QFCgiConnection::consumeOutput(qint64 nbytes) {
+  while (nbytes > 0 && !this->output.isEmpty()) {
+    qint64 remaining = this->output.first().length - this->outputOffset;
+
+    if (nbytes < remaining) {
+      this->outputOffset += nbytes;
+      return;
+    }
+
+    nbytes -= remaining;
+    removeOutputSegment();
+  }
+}
+
+bool QFCgiConnection::sendFileSegment() {
+  const OutputSegment &segment = this->output.first();
+  qint64 remaining = segment.length - this->outputOffset;
+  ssize_t nwritten;
+
+#ifdef Q_OS_LINUX
+  // the kernel copies straight from the file into the socket
+  off_t offset = segment.offset + this->outputOffset;
+  nwritten = sendfile(this->descriptor, segment.fd, &offset, remaining);
+#else
+  nwritten = -1;
+  errno = ENOSYS;
+#endif
+
+  if (nwritten < 0 && errno == EINTR) {
+    return true;
+  } else if (nwritten == remaining) {
+    consumeOutput(nwritten);
+    this->stats->bytesOut += nwritten;
+    return true;
+  } else if (nwritten == 0 ||
+             (nwritten < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINVAL && errno != ENOSYS)) {
+    q1Debug("sendfile: %s", (nwritten == 0) ? "unexpected end of file" : strerror(errno));
+    discardOutput();
+    deleteLater();
+    return false;
+  }
+
+  consumeOutput(qMax(nwritten, (ssize_t)0));
+  this->stats->bytesOut += qMax(nwritten, (ssize_t)0);
+
+  // The socket is full (or the file cannot be sent by the kernel), the
+  // device buffers the rest of the segment and notifies (onBytesWritten())
+  // when it is able to write again.
+  writeOutputSegment();
+  return false;
+}
+
+bool QFCgiConnection::writeOutputSegment() {
+  const OutputSegment &segment = this->output.first();
+
+  if (segment.fd == -1) {
+    this->device->write(segment.data.constData() + this->outputOffset, segment.length - this->outputOffset);
+    this->stats->bytesOut += segment.length - this->outputOffset;
+    removeOutputSegment();
+    return true;
+  }
+
+  QByteArray piece;
+  piece.resize(segment.length - this->outputOffset);
+
+  for (int pos = 0; pos < piece.size(); ) {
+    ssize_t nread = pread(segment.fd, piece.data() + pos, piece.size() - pos,
+                          segment.offset + this->outputOffset + pos);
+
+    if (nread < 0 && errno == EINTR) {
+      continue;
+    } else if (nread <= 0) {
+      q1Debug("pread: %s", (nread == 0) ? "unexpected end of file" : strerror(errno));
+      discardOutput();
+      deleteLater();
+      return false;
+    }
+
+    pos += nread;
+  }
+
+  this->device->write(piece);
+  this->stats->bytesOut += piece.size();
+  removeOutputSegment();
+  return true;
+}
+
+void QFCgiConnection::removeOutputSegment() {
+  int fd = this->output.first().fd;
+
+  this->output.removeFirst();
+  this->outputOffset = 0;
+  releaseOutputFile(fd);
+
+  if (this->output.isEmpty()) {
+    this->outputTail = false;
+  }
+}
+
+void QFCgiConnection::releaseOutputFile(int fd) {
+  if (fd != -1 && --this->outputFiles[fd] == 0) {
+    // last segment of the file
+    this->outputFiles.remove(fd);
+    ::close(fd);
+  }
+}
+
+void QFCgiConnection::discardOutput() {
+  Q_FOREACH(int fd, this->outputFiles.keys()) {
+    ::close(fd);
+  }
+
+  this->outputQueues.clear();
+  this->outputSchedule.clear();
+  this->output.clear();
+  this->outputFiles.clear();
+  this->outputOffset = 0;
+  this->outputTail = false;
+}
+
+void QFCgiConnection::discardRequestOutput(int requestId) {
+  QList<OutputRecord> queue = this->outputQueues.take(requestId);
+
+  for (int i = 0; i < queue.size(); i++) {
+    releaseOutputFile(queue.at(i).content.fd);
+  }
+
+  this->outputSchedule.removeAll(requestId);
+}
+
+bool QFCgiConnection::isBlocked(const QFCgiRecord &record) const {
+  QFCgiRequest *request = this->requests.value(record.getRequestId(), 0);
+
+  return record.getType() == QFCgiRecord::FCGI_STDIN &&
+         !record.getContent().isEmpty() &&
+         request != 0 &&
+         this->fcgi->getRequestInputLimit() > 0 &&
+         request->in->bytesInMemory() >= this->fcgi->getRequestInputLimit();
+}
+
+bool QFCgiConnection::isPaused() {
+  qint64 pending = updatePendingInput();
+  bool paused = this->blocked ||
+                (this->fcgi->getInputHighWaterMark() > 0 && pending >= this->fcgi->getInputHighWaterMark());
+
+  if (paused != this->paused) {
+    q1Debug("%s reading, %lli bytes pending", (paused ? "pause" : "resume"), pending);
+    this->paused = paused;
+  }
+
+  return paused;
+}
+
+qint64 QFCgiConnection::updatePendingInput() {
+  qint64 pending = this->buf.size();
+
+  Q_FOREACH(QFCgiRequest *request, this->requests) {
+    pending += request->in->bytesInMemory();
+  }
+
+  // the application server limits the sum of all connections
+  this->fcgi->updatePendingInput(pending - this->pendingInput);
+  this->pendingInput = pending;
+
+  return pending;
+}
+
+bool QFCgiConnection::admitRequest() {
+  if (this->fcgi->getMaxConnectionRequests() > 0 &&
+      this->activeRequests >= this->fcgi->getMaxConnectionRequests()) {
+    return false;
+  }
+
+  if (this->fcgi->getMaxConnectionPendingInput() > 0 &&
+      updatePendingInput() >= this->fcgi->getMaxConnectionPendingInput()) {
+    return false;
+  }
+
+  if (!this->fcgi->admitRequest()) {
+    return false;
+  }
+
+  this->activeRequests++;
+  return true;
+}
+
+QFCgiRequest* QFCgiConnection::acquireRequest(int id, bool keepConn) {
+  if (this->freeRequests.isEmpty()) {
+    return new QFCgiRequest(id, keepConn, this);
+  }
+
+  // saves the allocation of the request and its streams
+  QFCgiRequest *request = this->freeRequests.takeLast();
+  request->reset(id, keepConn);
+
+  return request;
+}
+
+void QFCgiConnection::rejectRequest(QFCgiRecord &record, enum QFCgiRecord::ProtocolStatus protocolStatus) {
+  // the remaining records of the request are still on their way
+  this->rejectedRequests.insert(record.getRequestId());
+  this->stats->rejectedRequests++;
+  send(QFCgiRecord::createEndRequest(record.getRequestId(), 0, protocolStatus));
 }
 
 void QFCgiConnection::handleManagementRecord(QFCgiRecord &record) {
-  q2Debug(record, "management record read");
+  q2Debug(record, "management record read [type: %d]", record.getRawType());
+
+  switch (record.getType()) {
+    case QFCgiRecord::FCGI_GET_VALUES: handleFCGI_GET_VALUES(record); break;
+    default: send(QFCgiRecord::createUnknownType(record.getRawType())); break;
+  }
+}
+
+void QFCgiConnection::handleFCGI_GET_VALUES(QFCgiRecord &record) {
+  const QByteArray &ba = record.getContent();
+  QList<QPair<QByteArray, QByteArray> > values;
+  QFCgiParams params;
+
+  params.consume(ba.constData(), ba.size());
+
+  // unknown variables and unlimited values are omitted
+  Q_FOREACH(QString name, params.names()) {
+    if (name == "FCGI_MAX_CONNS" && this->fcgi->getMaxConnections() > 0) {
+      values.append(qMakePair(name.toAscii(), QByteArray::number(this->fcgi->getMaxConnections())));
+    } else if (name == "FCGI_MAX_REQS" && this->fcgi->getMaxRequests() > 0) {
+      values.append(qMakePair(name.toAscii(), QByteArray::number(this->fcgi->getMaxRequests())));
+    } else if (name == "FCGI_MPXS_CONNS") {
+      bool multiplexed = (this->fcgi->getMaxConnectionRequests() != 1);
+      values.append(qMakePair(name.toAscii(), QByteArray(multiplexed ? "1" : "0")));
+    }
+  }
+
+  send(QFCgiRecord::createGetValuesResult(values));
 }
 
 void QFCgiConnection::handleApplicationRecord(QFCgiRecord &record) {
   QFCgiRequest *request = this->requests.value(record.getRequestId(), 0);
 
+  if (record.getType() == QFCgiRecord::FCGI_BEGIN_REQUEST) {
+    // the web server reuses the request-id of a rejected request
+    this->rejectedRequests.remove(record.getRequestId());
+  } else if (this->rejectedRequests.contains(record.getRequestId())) {
+    q2Debug(record, "record of rejected request skipped [type: %d]", record.getType());
+
+    if (record.getType() == QFCgiRecord::FCGI_STDIN && record.getContent().isEmpty()) {
+      // the last record of the request
+      this->rejectedRequests.remove(record.getRequestId());
+    }
+    return;
+  } else if (request == 0 && record.getType() == QFCgiRecord::FCGI_ABORT_REQUEST) {
+    // the request ended, while the abort was on its way
+    q2Debug(record, "FCGI_ABORT_REQUEST (request already ended)");
+    return;
+  }
+
   if (request == 0 && record.getType() != QFCgiRecord::FCGI_BEGIN_REQUEST) {
     q2Debug(record, "no such request");
     deleteLater();
@@ -123,6 +803,7 @@ void QFCgiConnection::handleApplicationRecord(QFCgiRecord &record) {
     case QFCgiRecord::FCGI_BEGIN_REQUEST: handleFCGI_BEGIN_REQUEST(record); break;
     case QFCgiRecord::FCGI_PARAMS: handleFCGI_PARAMS(request, record); break;
     case QFCgiRecord::FCGI_STDIN: handleFCGI_STDIN(request, record); break;
+    case QFCgiRecord::FCGI_ABORT_REQUEST: handleFCGI_ABORT_REQUEST(request, record); break;
     default: q2Debug(record, "invalid record of type %d", record.getType());
   }
 }
@@ -141,10 +822,24 @@ void QFCgiConnection::handleFCGI_BEGIN_REQUEST(QFCgiRecord &record) {
       send(response);
 
       closeConnection();
+    } else if (!admitRequest()) {
+      q2Debug(record, "new FastCGI request (overloaded) [role: %d, keep_conn: %d]", role, keep_conn);
+      rejectRequest(record, QFCgiRecord::FCGI_OVERLOADED);
+
+      if (!keep_conn) {
+        closeConnection();
+      }
     } else {
-      QFCgiRequest *request = new QFCgiRequest(record.getRequestId(), keep_conn, this);
+      QFCgiRequest *request = acquireRequest(record.getRequestId(), keep_conn);
       this->requests.insert(request->getId(), request);
+      request->beginTime = QFCgiStats::now();
+
+      request->in->setSpillThreshold(this->fcgi->getInputSpillThreshold());
+
+      connect(request->in, SIGNAL(bytesRead(qint64)), this, SLOT(onInputConsumed()));
+      connect(request->in, SIGNAL(aboutToClose()), this, SLOT(onInputConsumed()));
       q2Debug(record, "new FastCGI request [role: %d, keep_conn: %d]", role, keep_conn);
+      QFCGI_TRACE_REQUEST_BEGIN(this->id, request->getId(), keep_conn);
     }
   } else {
     bool valid = validateRole(role);
@@ -152,8 +847,7 @@ void QFCgiConnection::handleFCGI_BEGIN_REQUEST(QFCgiRecord &record) {
     q2Debug(record, "new FastCGI request (%s role) [role: %d, keep_conn: %d]",
       (valid ? "unsupported" : "invalid"), role, keep_conn);
 
-    QFCgiRecord response = QFCgiRecord::createEndRequest(record.getRequestId(), 0, QFCgiRecord::FCGI_UNKNOWN_ROLE);
-    send(response);
+    rejectRequest(record, QFCgiRecord::FCGI_UNKNOWN_ROLE);
 
     if (!valid) {
       // an invalid role will always close the connection
@@ -167,11 +861,22 @@ void QFCgiConnection::handleFCGI_PARAMS(QFCgiRequest *request, QFCgiRecord &reco
 
   if (!ba.isEmpty()) {
     q2Debug(record, "FCGI_PARAMS");
-    request->consumeParamsBuffer(ba);
+
+    if (!request->consumeParamsBuffer(ba)) {
+      // the stream is not trusted any further
+      q2Debug(record, "FCGI_PARAMS (pair too large)");
+      this->stats->parseErrors++;
+      this->rejectedRequests.insert(request->getId());
+      closeConnection();
+    }
   } else {
     q2Debug(record, "FCGI_PARAMS (end of stream)");
-    QFCgi *fcgi = qobject_cast<QFCgi*>(parent());
-    emit fcgi->newRequest(request);
+    request->paramsTime = QFCgiStats::now();
+    this->stats->startedRequests++;
+    this->stats->addLatency(QFCgiStats::ParamsLatency, request->paramsTime - request->beginTime);
+    this->fcgi->requestStarted();
+    QFCGI_TRACE_REQUEST_PARAMS_COMPLETE(this->id, request->getId());
+    emit this->fcgi->newRequest(request);
   }
 }
 
@@ -180,13 +885,34 @@ void QFCgiConnection::handleFCGI_STDIN(QFCgiRequest *request, QFCgiRecord &recor
 
   if (!ba.isEmpty()) {
     q2Debug(record, "FCGI_STDIN");
-    request->in->append(ba);
+
+    // Input of a closed stream is dropped. Otherwise the input could not be
+    // stored (e.g. the disk is full), the request must not see a truncated
+    // body.
+    if (!request->in->append(ba) && request->in->isOpen()) {
+      q2Debug(record, "FCGI_STDIN (failed to store input)");
+      this->rejectedRequests.insert(request->getId());
+      closeConnection();
+    }
   } else {
     q2Debug(record, "FCGI_STDIN (end of stream)");
+    QFCGI_TRACE_REQUEST_STDIN_EOF(this->id, request->getId());
     request->in->setEof();
   }
 }
 
+void QFCgiConnection::handleFCGI_ABORT_REQUEST(QFCgiRequest *request, QFCgiRecord &record) {
+  q2Debug(record, "FCGI_ABORT_REQUEST");
+
+  // Records of the request, which are still on their way, are skipped.
+  // Queued output is dropped, only records already moved into the output
+  // are sent.
+  this->rejectedRequests.insert(request->getId());
+  this->stats->abortedRequests++;
+  discardRequestOutput(request->getId());
+  request->abort();
+}
+
 bool QFCgiConnection::validateRole(quint16 role) const {
   switch (role) {
     case FCGI_RESPONDER:
@@ -18,43 +18,122 @@
 #ifndef QFCGI_CONNECTION_H
 #define QFCGI_CONNECTION_H
 
+#include <QAtomicInt>
 #include <QHash>
+#include <QList>
 #include <QObject>
+#include <QSet>
+
+#include "buffer.h"
+#include "record.h"
 
 class QFCgi;
-class QFCgiRecord;
 class QFCgiRequest;
+class QFCgiStats;
 class QIODevice;
 
 class QFCgiConnection : public QObject {
   Q_OBJECT
 
 public:
-  QFCgiConnection(QIODevice *device, QFCgi *parent);
+  QFCgiConnection(QIODevice *device, QFCgi *fcgi, QFCgiStats *stats, QObject *parent = 0);
   virtual ~QFCgiConnection();
 
   int getId() const;
 
   void send(const QFCgiRecord &record);
+  bool sendFile(quint16 requestId, int fd, qint64 offset, qint64 length);
   void closeConnection();
+  void drain();
+  void requestEnded(QFCgiRequest *request);
+  void recycleRequest(QFCgiRequest *request);
+  void releaseAbortedRequest(QFCgiRequest *request);
 
 private slots:
   void onReadyRead();
   void onDisconnected();
+  void onInputConsumed();
+  void onBytesWritten();
+  void flush();
+  void recycleRequests();
 
 private:
-  void fillBuffer();
+  /*
+   * A part of the output, either data in memory or a range of a file.
+   */
+  struct OutputSegment {
+    OutputSegment() : fd(-1), offset(0), length(0) {}
+    OutputSegment(const QByteArray &data) : data(data), fd(-1), offset(0), length(data.size()) {}
+    OutputSegment(int fd, qint64 offset, qint64 length) : fd(fd), offset(offset), length(length) {}
+
+    QByteArray data;
+    int fd;
+    qint64 offset;
+    qint64 length;
+  };
+
+  /*
+   * A record queued by a request, until the scheduler moves it into the
+   * output.
+   */
+  struct OutputRecord {
+    char header[FCGI_HEADER_LEN];
+    quint8 paddingLength;
+    OutputSegment content;
+  };
+
+  qint64 fillBuffer();
+  bool processBuffer();
+  bool isBlocked(const QFCgiRecord &record) const;
+  bool isPaused();
+  qint64 updatePendingInput();
+  bool admitRequest();
+  QFCgiRequest* acquireRequest(int id, bool keepConn);
+  void rejectRequest(QFCgiRecord &record, enum QFCgiRecord::ProtocolStatus protocolStatus);
+  void enqueueRecord(quint16 requestId, const OutputRecord &record);
+  void appendRecord(const OutputRecord &record);
+  bool scheduleOutput();
+  void appendOutput(const char *data, int size);
+  void scheduleFlush();
+  void consumeOutput(qint64 nbytes);
+  bool sendFileSegment();
+  bool writeOutputSegment();
+  void removeOutputSegment();
+  void releaseOutputFile(int fd);
+  void discardOutput();
+  void discardRequestOutput(int requestId);
   void handleManagementRecord(QFCgiRecord &record);
+  void handleFCGI_GET_VALUES(QFCgiRecord &record);
   void handleApplicationRecord(QFCgiRecord &record);
   void handleFCGI_BEGIN_REQUEST(QFCgiRecord &record);
   void handleFCGI_PARAMS(QFCgiRequest *request, QFCgiRecord &record);
   void handleFCGI_STDIN(QFCgiRequest *request, QFCgiRecord &record);
+  void handleFCGI_ABORT_REQUEST(QFCgiRequest *request, QFCgiRecord &record);
   bool validateRole(quint16 role) const;
 
   int id;
+  QFCgi *fcgi;
+  QFCgiStats *stats;
   QIODevice *device;
-  QByteArray buf;
+  QFCgiBuffer buf;
+  bool paused;
+  bool draining;
+  bool blocked;
+  int descriptor;
+  QList<OutputSegment> output;
+  QHash<int, int> outputFiles;
+  int outputOffset;
+  bool outputTail;
+  bool flushScheduled;
+  QHash<int, QList<OutputRecord> > outputQueues;
+  QList<int> outputSchedule;
   QHash<int, QFCgiRequest*> requests;
+  QList<QFCgiRequest*> endedRequests;
+  QList<QFCgiRequest*> freeRequests;
+  int activeRequests;
+  int abortedRequests;
+  qint64 pendingInput;
+  QSet<int> rejectedRequests;
 };
 
 #endif  /* QFCGI_CONNECTION_H */
@@ -15,25 +15,57 @@
  * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <QTcpServer>
-#include <QTcpSocket>
+#include <QCoreApplication>
+#include <QThread>
+#include <QTimer>
+
+#include <unistd.h>
 
 #include "connection.h"
 #include "fcgi.h"
 #include "fdbuilder.h"
 #include "localbuilder.h"
+#include "metrics.h"
+#include "request.h"
+#include "supervisor.h"
 #include "tcpbuilder.h"
+#include "worker.h"
 
 QFCgi::QFCgi(QObject *parent) : QObject(parent) {
-  this->builder = new QFCgiTcpConnectionBuilder(QHostAddress::Any, 9000, this);
+  this->builder = new QFCgiTcpConnectionBuilder(QHostAddress::Any, 9000, false, this);
+  this->readChunkSize = 65536;
+  this->inputHighWaterMark = 0;
+  this->requestInputLimit = 0;
+  this->inputSpillThreshold = 0;
+  this->workerCount = 0;
+  this->workerListeners = false;
+  this->nextWorker = 0;
+  this->processCount = 0;
+  this->processMaxRequests = 0;
+  this->acceptBudget = 64;
+  this->outputQuantum = 65536;
+  this->maxConnections = 0;
+  this->maxRequests = 0;
+  this->maxConnectionRequests = 0;
+  this->maxPendingInput = 0;
+  this->maxConnectionPendingInput = 0;
+  this->pendingInput = 0;
+  this->supervisor = 0;
+  this->draining = false;
+  this->statsTimer = 0;
+  this->metrics = 0;
+
+  // requests and statistics are signaled across threads
+  qRegisterMetaType<QFCgiRequest*>();
+  qRegisterMetaType<QFCgiStats>();
 }
 
 QFCgi::~QFCgi() {
-
+  stopWorkers();
 }
 
-void QFCgi::configureListen(const QHostAddress &address, quint16 port) {
-  updateBuilder(new QFCgiTcpConnectionBuilder(address, port, this));
+void QFCgi::configureListen(const QHostAddress &address, quint16 port, enum ListenMode mode) {
+  updateBuilder(new QFCgiTcpConnectionBuilder(address, port, (mode == ReusePortListener), this));
 }
 
 void QFCgi::configureListen(const QString &path) {
@@ -44,11 +76,190 @@ void QFCgi::configureListen(enum FileDescriptor fd) {
   updateBuilder(new QFCgiFdConnectionBuilder(fd, this));
 }
 
+void QFCgi::configureMetrics(const QHostAddress &address, quint16 port) {
+  delete this->metrics;
+  this->metrics = new QFCgiMetrics(this, new QFCgiTcpConnectionBuilder(address, port, false, 0), this);
+}
+
+void QFCgi::configureMetrics(const QString &path) {
+  delete this->metrics;
+  this->metrics = new QFCgiMetrics(this, new QFCgiLocalConnectionBuilder(path, 0), this);
+}
+
+int QFCgi::getReadChunkSize() const {
+  return this->readChunkSize;
+}
+
+void QFCgi::setReadChunkSize(int size) {
+  this->readChunkSize = qMax(size, 1);
+}
+
+qint64 QFCgi::getInputHighWaterMark() const {
+  return this->inputHighWaterMark;
+}
+
+void QFCgi::setInputHighWaterMark(qint64 size) {
+  this->inputHighWaterMark = size;
+}
+
+qint64 QFCgi::getRequestInputLimit() const {
+  return this->requestInputLimit;
+}
+
+void QFCgi::setRequestInputLimit(qint64 size) {
+  this->requestInputLimit = size;
+}
+
+qint64 QFCgi::getInputSpillThreshold() const {
+  return this->inputSpillThreshold;
+}
+
+void QFCgi::setInputSpillThreshold(qint64 size) {
+  this->inputSpillThreshold = size;
+}
+
+int QFCgi::getWorkerCount() const {
+  return this->workerCount;
+}
+
+void QFCgi::setWorkerCount(int count) {
+  this->workerCount = qMax(count, 0);
+}
+
+int QFCgi::getProcessCount() const {
+  return this->processCount;
+}
+
+void QFCgi::setProcessCount(int count) {
+  this->processCount = qMax(count, 0);
+}
+
+int QFCgi::getProcessMaxRequests() const {
+  return this->processMaxRequests;
+}
+
+void QFCgi::setProcessMaxRequests(int count) {
+  this->processMaxRequests = qMax(count, 0);
+}
+
+int QFCgi::getAcceptBudget() const {
+  return this->acceptBudget;
+}
+
+void QFCgi::setAcceptBudget(int budget) {
+  this->acceptBudget = qMax(budget, 1);
+}
+
+int QFCgi::getOutputQuantum() const {
+  return this->outputQuantum;
+}
+
+void QFCgi::setOutputQuantum(int size) {
+  this->outputQuantum = qMax(size, 1);
+}
+
+int QFCgi::getMaxConnections() const {
+  return this->maxConnections;
+}
+
+void QFCgi::setMaxConnections(int count) {
+  this->maxConnections = qMax(count, 0);
+}
+
+int QFCgi::getMaxRequests() const {
+  return this->maxRequests;
+}
+
+void QFCgi::setMaxRequests(int count) {
+  this->maxRequests = qMax(count, 0);
+}
+
+int QFCgi::getMaxConnectionRequests() const {
+  return this->maxConnectionRequests;
+}
+
+void QFCgi::setMaxConnectionRequests(int count) {
+  this->maxConnectionRequests = qMax(count, 0);
+}
+
+qint64 QFCgi::getMaxPendingInput() const {
+  return this->maxPendingInput;
+}
+
+void QFCgi::setMaxPendingInput(qint64 size) {
+  this->maxPendingInput = size;
+}
+
+qint64 QFCgi::getMaxConnectionPendingInput() const {
+  return this->maxConnectionPendingInput;
+}
+
+void QFCgi::setMaxConnectionPendingInput(qint64 size) {
+  this->maxConnectionPendingInput = size;
+}
+
+QFCgiStats QFCgi::getStats() const {
+  QFCgiStats stats;
+
+  if (this->threads.contains(QThread::currentThread())) {
+    // waiting for the other worker threads, which might wait for this one
+    qWarning("QFCgi::getStats() invoked on a worker thread");
+    return stats;
+  }
+
+  Q_FOREACH(QFCgiWorker *worker, this->workers) {
+    stats.merge(worker->getStats());
+  }
+
+  return stats;
+}
+
+int QFCgi::getStatsInterval() const {
+  return (this->statsTimer != 0) ? this->statsTimer->interval() : 0;
+}
+
+void QFCgi::setStatsInterval(int msecs) {
+  if (msecs <= 0) {
+    delete this->statsTimer;
+    this->statsTimer = 0;
+    return;
+  }
+
+  if (this->statsTimer == 0) {
+    this->statsTimer = new QTimer(this);
+    connect(this->statsTimer, SIGNAL(timeout()), this, SLOT(onStatsTimeout()));
+  }
+
+  this->statsTimer->start(msecs);
+}
+
 bool QFCgi::isStarted() const {
+  if (this->supervisor != 0 && this->supervisor->isSupervising()) {
+    return true;
+  }
+
+  if (this->workerListeners) {
+    Q_FOREACH(QFCgiWorker *worker, this->workers) {
+      if (!worker->isListening()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   return (this->builder != 0) && this->builder->isListening();
 }
 
 QString QFCgi::errorString() const {
+  if (this->workerListeners) {
+    Q_FOREACH(QFCgiWorker *worker, this->workers) {
+      if (!worker->isListening()) {
+        return worker->errorString();
+      }
+    }
+    return "";
+  }
+
   if (this->builder != 0) {
     return this->builder->errorString();
   } else {
@@ -57,19 +268,237 @@ QString QFCgi::errorString() const {
 }
 
 void QFCgi::start() {
+  if (this->processCount > 0 && this->supervisor == 0 &&
+      qobject_cast<QFCgiFdConnectionBuilder*>(this->builder) != 0) {
+
+    if (this->metrics != 0) {
+      // nobody sums up the statistics of the worker processes
+      qWarning("the metrics socket is not served with worker processes");
+    }
+
+    this->supervisor = new QFCgiSupervisor(this->processCount, this);
+    connect(this->supervisor, SIGNAL(processStarted()), this, SLOT(onProcessStarted()));
+    connect(this->supervisor, SIGNAL(terminate()), this, SLOT(drain()));
+
+    if (this->supervisor->start()) {
+      // the worker processes continue in onProcessStarted()
+      return;
+    }
+
+    delete this->supervisor;
+    this->supervisor = 0;
+  }
+
+  listen();
+  listenMetrics();
+}
+
+void QFCgi::listenMetrics() {
+  if (this->metrics == 0 || this->metrics->isListening()) {
+    return;
+  }
+
+  if (!this->metrics->listen()) {
+    qDebug("failed to start metrics socket: %s", qPrintable(this->metrics->errorString()));
+  }
+}
+
+void QFCgi::listen() {
+  startWorkers();
+  this->builder->setAcceptBudget(this->acceptBudget);
+
+  if (!this->threads.isEmpty() && !this->workerListeners) {
+    Q_FOREACH(QFCgiWorker *worker, this->workers) {
+      QFCgiConnectionBuilder *builder = this->builder->createWorkerBuilder();
+
+      if (builder == 0) {
+        break;
+      }
+
+      this->workerListeners = true;
+      builder->setAcceptBudget(this->acceptBudget);
+
+      if (!worker->listen(builder)) {
+        qDebug("failed to start FastCGI worker: %s", qPrintable(worker->errorString()));
+      }
+    }
+  }
+
+  if (this->workerListeners) {
+    return;
+  }
+
   if (this->builder->listen()) {
-    connect(this->builder, SIGNAL(newConnection(QFCgiConnection*)),
-            this, SLOT(onNewConnection(QFCgiConnection*)));
+    connect(this->builder, SIGNAL(newConnection(int)),
+            this, SLOT(onNewConnection(int)));
   } else {
     qDebug("failed to start FastCGI application: %s", qPrintable(this->builder->errorString()));
   }
 }
 
-void QFCgi::onNewConnection(QFCgiConnection *connection) {
-  qDebug("[%d] FastCGI connection accepted", connection->getId());
+void QFCgi::onNewConnection(int descriptor) {
+  QFCgiWorker *worker = 0;
+
+  if (!admitConnection()) {
+    ::close(descriptor);
+    return;
+  }
+
+  // least loaded worker, ties are broken round-robin
+  for (int i = 0; i < this->workers.size(); i++) {
+    QFCgiWorker *candidate = this->workers.at((this->nextWorker + i) % this->workers.size());
+
+    if (worker == 0 || candidate->getConnectionCount() < worker->getConnectionCount()) {
+      worker = candidate;
+    }
+  }
+
+  this->nextWorker = (this->nextWorker + 1) % this->workers.size();
+  worker->dispatch(descriptor, this->builder->getSocketType());
+}
+
+void QFCgi::onConnectionClosed() {
+  if (!this->draining) {
+    return;
+  }
+
+  Q_FOREACH(QFCgiWorker *worker, this->workers) {
+    if (worker->getConnectionCount() > 0) {
+      return;
+    }
+  }
+
+  qDebug("FastCGI worker process %d finished", (int)getpid());
+
+  if (this->supervisor != 0) {
+    QCoreApplication::exit(0);
+  }
+}
+
+void QFCgi::onProcessStarted() {
+  listen();
+}
+
+void QFCgi::onStatsTimeout() {
+  emit statsUpdated(getStats());
+}
+
+void QFCgi::drain() {
+  if (this->draining) {
+    return;
+  }
+
+  qDebug("FastCGI worker process %d draining", (int)getpid());
+  this->draining = true;
+
+  this->builder->close();
+
+  Q_FOREACH(QFCgiWorker *worker, this->workers) {
+    // idle connections are closed, the others after their last request
+    QMetaObject::invokeMethod(worker, "drain");
+  }
+
+  onConnectionClosed();
+}
+
+bool QFCgi::admitConnection() {
+  int count = this->connectionCount.fetchAndAddRelaxed(1) + 1;
+
+  if (this->maxConnections > 0 && count > this->maxConnections) {
+    qDebug("connection limit of %d reached, connection refused", this->maxConnections);
+    this->connectionCount.deref();
+    return false;
+  }
+
+  return true;
+}
+
+void QFCgi::releaseConnection() {
+  this->connectionCount.deref();
+}
+
+bool QFCgi::admitRequest() {
+  if (this->maxPendingInput > 0) {
+    QMutexLocker locker(&this->pendingInputMutex);
+
+    if (this->pendingInput >= this->maxPendingInput) {
+      return false;
+    }
+  }
+
+  int count = this->activeRequests.fetchAndAddRelaxed(1) + 1;
+
+  if (this->maxRequests > 0 && count > this->maxRequests) {
+    this->activeRequests.deref();
+    return false;
+  }
+
+  return true;
+}
+
+void QFCgi::releaseRequest() {
+  this->activeRequests.deref();
+}
+
+void QFCgi::updatePendingInput(qint64 delta) {
+  if (delta != 0) {
+    QMutexLocker locker(&this->pendingInputMutex);
+    this->pendingInput += delta;
+  }
+}
+
+void QFCgi::requestStarted() {
+  int count = this->requestCount.fetchAndAddRelaxed(1) + 1;
+
+  if (this->supervisor != 0 && count == this->processMaxRequests) {
+    // replaced by the supervisor
+    QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+  }
 }
 
 void QFCgi::updateBuilder(QFCgiConnectionBuilder *builder) {
   delete this->builder;
   this->builder = builder;
 }
+
+void QFCgi::startWorkers() {
+  if (!this->workers.isEmpty()) {
+    return;
+  }
+
+  if (this->workerCount == 0) {
+    QFCgiWorker *worker = new QFCgiWorker(this, this);
+    connect(worker, SIGNAL(connectionClosed()), this, SLOT(onConnectionClosed()));
+    this->workers.append(worker);
+    return;
+  }
+
+  for (int i = 0; i < this->workerCount; i++) {
+    QThread *thread = new QThread(this);
+    QFCgiWorker *worker = new QFCgiWorker(this);
+
+    worker->moveToThread(thread);
+    connect(worker, SIGNAL(connectionClosed()), this, SLOT(onConnectionClosed()));
+    thread->start();
+
+    this->threads.append(thread);
+    this->workers.append(worker);
+  }
+
+  qDebug("started %d FastCGI worker threads", this->workerCount);
+}
+
+void QFCgi::stopWorkers() {
+  Q_FOREACH(QThread *thread, this->threads) {
+    thread->quit();
+    thread->wait();
+  }
+
+  // the workers destroy their connections
+  qDeleteAll(this->workers);
+  this->workers.clear();
+  this->workerListeners = false;
+
+  qDeleteAll(this->threads);
+  this->threads.clear();
+}
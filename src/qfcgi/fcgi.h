@@ -20,10 +20,21 @@
 
 #include <QObject>
 
+#include <QAtomicInt>
+#include <QList>
+#include <QMutex>
+
+#include "stats.h"
+
 class QFCgiConnection;
 class QFCgiConnectionBuilder;
+class QFCgiMetrics;
 class QFCgiRequest;
+class QFCgiSupervisor;
+class QFCgiWorker;
 class QHostAddress;
+class QThread;
+class QTimer;
 
 /**
  * FastCGI support for Qt.
@@ -38,6 +49,9 @@ class QHostAddress;
  *
  * For reach request received from the web server the #newRequest() signal is
  * emitted.
+ *
+ * By default connections are served on the thread of the QFCgi instance. Use
+ * #setWorkerCount() to serve them on a pool of worker threads.
  */
 class QFCgi : public QObject {
   Q_OBJECT
@@ -54,6 +68,25 @@ public:
     FCGI_LISTENSOCK_FILENO = 0
   };
 
+  /**
+   * How TCP connections are accepted, when #setWorkerCount() worker threads
+   * are used.
+   */
+  enum ListenMode {
+    /**
+     * A single listening socket accepts all connections and hands them over
+     * to the workers.
+     */
+    SharedListener,
+
+    /**
+     * Every worker thread listens on a socket of its own, bound to the same
+     * address and port with <code>SO_REUSEPORT</code>. The kernel distributes
+     * the connections among the sockets.
+     */
+    ReusePortListener
+  };
+
   /**
    * Creates a new instance of the class.
    */
@@ -67,10 +100,14 @@ public:
    * After a #start() invocation the application server accepts TCP connections
    * on the adress/port combination.
    *
+   * With #ReusePortListener every worker thread accepts connections on a
+   * socket of its own, which needs a fixed <code>port</code>.
+   *
    * @param address IP address
    * @param port Port number
+   * @param mode How connections are accepted by the worker threads
    */
-  void configureListen(const QHostAddress &address, quint16 port);
+  void configureListen(const QHostAddress &address, quint16 port, enum ListenMode mode = SharedListener);
 
   /**
    * Configures the FastCGI application server for listening on the given
@@ -98,6 +135,448 @@ public:
    */
   void configureListen(enum FileDescriptor fd);
 
+  /**
+   * Configures an admin socket on the given address and port, where the
+   * statistics are served in the Prometheus text format.
+   *
+   * After a #start() invocation the application server answers HTTP requests
+   * for <code>/metrics</code> on the socket. The counters and histograms of
+   * #getStats() are reported per worker thread, labeled with
+   * <code>worker</code>.
+   *
+   * With worker processes (#setProcessCount()) the admin socket is not served
+   * at all. The supervisor has no statistics, and every worker process only
+   * has statistics of its own. #start() logs a warning then.
+   *
+   * @param address IP address
+   * @param port Port number
+   */
+  void configureMetrics(const QHostAddress &address, quint16 port);
+
+  /**
+   * Configures an admin socket on the given UNIX domain socket, where the
+   * statistics are served in the Prometheus text format.
+   *
+   * @param path The path to the UNIX domain socket
+   * @see configureMetrics(const QHostAddress &address, quint16 port)
+   */
+  void configureMetrics(const QString &path);
+
+  /**
+   * Returns the maximum number of bytes read from a connection at once.
+   *
+   * @return Maximum size of a single read operation
+   * @see setReadChunkSize()
+   */
+  int getReadChunkSize() const;
+
+  /**
+   * Sets the maximum number of bytes read from a connection at once.
+   *
+   * Data are read directly into the input buffer of the connection, the
+   * chunk size bounds the number of bytes the buffer grows with a single
+   * read operation. The default is 64 KiB.
+   *
+   * @param size Maximum size of a single read operation
+   */
+  void setReadChunkSize(int size);
+
+  /**
+   * Returns the number of input-bytes a connection buffers, before it stops
+   * reading from the web server.
+   *
+   * @return The high-water mark of a connection
+   * @see setInputHighWaterMark()
+   */
+  qint64 getInputHighWaterMark() const;
+
+  /**
+   * Sets the number of input-bytes a connection buffers, before it stops
+   * reading from the web server.
+   *
+   * Input-data, which were received from the web server but not yet read by
+   * the application from QFCgiRequest::getIn(), are counted against the
+   * high-water mark. Once the mark is reached, the connection stops reading
+   * until the application consumes the input-data of the requests. This
+   * bounds the memory per connection when large request bodies are uploaded.
+   *
+   * By default the high-water mark is disabled (<code>0</code>).
+   *
+   * @param size The high-water mark of a connection, <code>0</code> disables
+   *             the high-water mark.
+   * @note With a high-water mark the application needs to read the input
+   *       while it arrives. An application, which waits for the end of the
+   *       input-stream before reading, will wait forever for large request
+   *       bodies.
+   */
+  void setInputHighWaterMark(qint64 size);
+
+  /**
+   * Returns the number of input-bytes buffered for a single request.
+   *
+   * @return The input-limit of a request
+   * @see setRequestInputLimit()
+   */
+  qint64 getRequestInputLimit() const;
+
+  /**
+   * Sets the number of input-bytes buffered for a single request.
+   *
+   * Enables the streaming-mode for QFCgiRequest::getIn(). Once the
+   * application has not yet read the given number of bytes, no more input
+   * is delivered to the request and the connection stops reading from the web
+   * server. Reading continues, when the application consumes the input-data.
+   *
+   * By default the limit is disabled (<code>0</code>), the whole request body
+   * is buffered.
+   *
+   * @param size The input-limit of a request, <code>0</code> disables the
+   *             limit.
+   * @note The same as for setInputHighWaterMark() applies, the application
+   *       needs to read the input while it arrives.
+   */
+  void setRequestInputLimit(qint64 size);
+
+  /**
+   * Returns the size of a request body, above which the body is moved into a
+   * temporary file.
+   *
+   * @return The spill-threshold of a request
+   * @see setInputSpillThreshold()
+   */
+  qint64 getInputSpillThreshold() const;
+
+  /**
+   * Sets the size of a request body, above which the body is moved into a
+   * temporary file.
+   *
+   * Once a request received more input-data than the given threshold, the
+   * data are written into an unlinked file in <code>QDir::tempPath()</code>
+   * instead of being buffered in memory. When the whole body is received, the
+   * file is mapped into memory and QFCgiRequest::getIn() reads from the
+   * mapping. QFCgiRequest::getInFileDescriptor() returns the file, e.g. to
+   * pass it to another process without reading it.
+   *
+   * Data kept in the file are not counted against the
+   * setInputHighWaterMark() and the setRequestInputLimit().
+   *
+   * By default the threshold is disabled (<code>0</code>), the whole request
+   * body is buffered in memory.
+   *
+   * @param size The spill-threshold of a request, <code>0</code> disables
+   *             spilling.
+   */
+  void setInputSpillThreshold(qint64 size);
+
+  /**
+   * Returns the number of worker threads serving connections.
+   *
+   * @return The number of worker threads
+   * @see setWorkerCount()
+   */
+  int getWorkerCount() const;
+
+  /**
+   * Sets the number of worker threads serving connections.
+   *
+   * Each worker runs an event loop of its own. Accepted connections are
+   * handed over to the worker serving the fewest connections. The connection
+   * and its requests live on the thread of the worker, thus the #newRequest()
+   * signal is emitted on the worker thread. Connect to the signal with a
+   * <code>Qt::DirectConnection</code> to process the request on the worker
+   * thread, and only touch the request from there.
+   *
+   * By default no worker threads are started (<code>0</code>), connections
+   * are served on the thread of the QFCgi instance.
+   *
+   * The setting is applied by #start(), call the method before.
+   *
+   * @param count The number of worker threads, <code>0</code> serves the
+   *              connections on the current thread.
+   */
+  void setWorkerCount(int count);
+
+  /**
+   * Returns the number of worker processes accepting connections.
+   *
+   * @return The number of worker processes
+   * @see setProcessCount()
+   */
+  int getProcessCount() const;
+
+  /**
+   * Sets the number of worker processes accepting connections.
+   *
+   * Only used together with #FCGI_LISTENSOCK_FILENO, where the web server
+   * passes the listening socket on <code>stdin</code>. #start() forks the
+   * given number of worker processes, which all accept connections on the
+   * inherited socket. The original process becomes a supervisor, which does
+   * not accept connections itself:
+   *
+   * - A worker process, which exits, is respawned. A crashed worker process
+   *   is respawned after a short delay.
+   * - On <code>SIGTERM</code> the supervisor forwards the signal to the
+   *   worker processes and leaves the event loop
+   *   (<code>QCoreApplication::exit()</code>), when the last one has exited.
+   * - On <code>SIGTERM</code> a worker process stops accepting connections.
+   *   Idle connections are closed right away, the others after their last
+   *   request ended. The worker process leaves the event loop, when its
+   *   connections are closed.
+   *
+   * Use the mode for handlers, which are not thread-safe, or to isolate
+   * requests from each other. Worker threads (#setWorkerCount()) are started
+   * in every worker process. The admin socket (#configureMetrics()) is not
+   * served in the mode.
+   *
+   * By default no worker processes are forked (<code>0</code>).
+   *
+   * @param count The number of worker processes, <code>0</code> accepts the
+   *              connections in the current process.
+   * @note Call #start() before entering the event loop and before starting
+   *       any threads.
+   */
+  void setProcessCount(int count);
+
+  /**
+   * Returns the number of requests served by a worker process before it is
+   * replaced.
+   *
+   * @return The number of requests served by a worker process
+   * @see setProcessMaxRequests()
+   */
+  int getProcessMaxRequests() const;
+
+  /**
+   * Sets the number of requests served by a worker process before it is
+   * replaced.
+   *
+   * Once a worker process (see #setProcessCount()) received the given number
+   * of requests, it stops accepting connections and exits like on
+   * <code>SIGTERM</code>. The supervisor forks a new worker process instead.
+   *
+   * By default worker processes are not recycled (<code>0</code>).
+   *
+   * @param count The number of requests, <code>0</code> disables recycling.
+   */
+  void setProcessMaxRequests(int count);
+
+  /**
+   * Returns the number of connections accepted at once.
+   *
+   * @return The accept-budget
+   * @see setAcceptBudget()
+   */
+  int getAcceptBudget() const;
+
+  /**
+   * Sets the number of connections accepted at once.
+   *
+   * When the listening socket becomes readable, pending connections are
+   * accepted in a loop, until either no more connections are pending or the
+   * given number of connections is accepted. The remaining connections are
+   * accepted with the next iteration of the event loop, which gives already
+   * accepted connections a chance to proceed.
+   *
+   * A larger value drains a burst of connections (e.g. after a restart of the
+   * web server) with fewer round-trips through the event loop.
+   *
+   * The default accept-budget is <code>64</code>. The setting is applied by
+   * #start(), call the method before.
+   *
+   * @param budget The number of connections accepted at once, at least
+   *               <code>1</code>.
+   */
+  void setAcceptBudget(int budget);
+
+  /**
+   * Returns the number of output-bytes a request sends at once, when requests
+   * share a connection.
+   *
+   * @return The output-quantum of a request
+   * @see setOutputQuantum()
+   */
+  int getOutputQuantum() const;
+
+  /**
+   * Sets the number of output-bytes a request sends at once, when requests
+   * share a connection.
+   *
+   * The web server can multiplex requests over a single connection. The
+   * output of every request is queued separately and the requests take turns
+   * sending their output: each one moves up to the given number of bytes (at
+   * least a whole record) per round. A small response is delayed by a quantum
+   * of a large response sharing the connection, instead of its whole size.
+   *
+   * A request alone on its connection moves 16 quanta per round, so a request
+   * started later is not queued behind its whole output. The default
+   * output-quantum is 64 KiB.
+   *
+   * @param size The output-quantum of a request
+   */
+  void setOutputQuantum(int size);
+
+  /**
+   * Returns the maximum number of concurrent connections.
+   *
+   * @return The maximum number of connections
+   * @see setMaxConnections()
+   */
+  int getMaxConnections() const;
+
+  /**
+   * Sets the maximum number of concurrent connections.
+   *
+   * Connections accepted beyond the limit are closed right away, the web
+   * server can pass the request to another application server instead of
+   * waiting for a busy one.
+   *
+   * The value is also reported to the web server as
+   * <code>FCGI_MAX_CONNS</code>, when it asks for it with a
+   * <code>FCGI_GET_VALUES</code> record. Web servers can use it to size their
+   * pool of upstream connections.
+   *
+   * By default the number of connections is not limited (<code>0</code>).
+   *
+   * @param count The maximum number of connections, <code>0</code> means
+   *              unlimited.
+   */
+  void setMaxConnections(int count);
+
+  /**
+   * Returns the maximum number of concurrent requests.
+   *
+   * @return The maximum number of requests
+   * @see setMaxRequests()
+   */
+  int getMaxRequests() const;
+
+  /**
+   * Sets the maximum number of concurrent requests.
+   *
+   * A request is in flight from its <code>FCGI_BEGIN_REQUEST</code> record
+   * until QFCgiRequest::endRequest() is called or its connection is closed.
+   * New requests beyond the limit are rejected with
+   * <code>FCGI_OVERLOADED</code>, before any of them is signaled with
+   * #newRequest(). The requests already admitted are served without
+   * competing with the rejected ones.
+   *
+   * The value is also reported to the web server as
+   * <code>FCGI_MAX_REQS</code>, when it asks for it with a
+   * <code>FCGI_GET_VALUES</code> record.
+   *
+   * By default the number of requests is not limited (<code>0</code>).
+   *
+   * @param count The maximum number of requests, <code>0</code> means
+   *              unlimited.
+   */
+  void setMaxRequests(int count);
+
+  /**
+   * Returns the maximum number of concurrent requests on a single connection.
+   *
+   * @return The maximum number of requests of a connection
+   * @see setMaxConnectionRequests()
+   */
+  int getMaxConnectionRequests() const;
+
+  /**
+   * Sets the maximum number of concurrent requests on a single connection.
+   *
+   * Like #setMaxRequests() but counted per connection, new requests beyond
+   * the limit are rejected with <code>FCGI_OVERLOADED</code>. With a limit of
+   * <code>1</code> the application server reports
+   * <code>FCGI_MPXS_CONNS</code> as <code>0</code>, the web server does not
+   * multiplex requests over a connection.
+   *
+   * By default the number of requests is not limited (<code>0</code>).
+   *
+   * @param count The maximum number of requests of a connection,
+   *              <code>0</code> means unlimited.
+   */
+  void setMaxConnectionRequests(int count);
+
+  /**
+   * Returns the number of pending input-bytes, above which new requests are
+   * rejected.
+   *
+   * @return The pending input-limit of the application server
+   * @see setMaxPendingInput()
+   */
+  qint64 getMaxPendingInput() const;
+
+  /**
+   * Sets the number of pending input-bytes, above which new requests are
+   * rejected.
+   *
+   * Input-data received from the web server and not yet read by the
+   * application are pending, counted over all connections the same way as for
+   * #setInputHighWaterMark(). While the given number of bytes is pending, new
+   * requests are rejected with <code>FCGI_OVERLOADED</code>.
+   *
+   * By default the limit is disabled (<code>0</code>).
+   *
+   * @param size The pending input-limit, <code>0</code> disables the limit.
+   */
+  void setMaxPendingInput(qint64 size);
+
+  /**
+   * Returns the number of pending input-bytes of a connection, above which
+   * new requests of the connection are rejected.
+   *
+   * @return The pending input-limit of a connection
+   * @see setMaxConnectionPendingInput()
+   */
+  qint64 getMaxConnectionPendingInput() const;
+
+  /**
+   * Sets the number of pending input-bytes of a connection, above which new
+   * requests of the connection are rejected.
+   *
+   * Like #setMaxPendingInput() but counted per connection. Unlike the
+   * #setInputHighWaterMark(), which stops reading from the connection, the
+   * requests already admitted keep receiving their input.
+   *
+   * By default the limit is disabled (<code>0</code>).
+   *
+   * @param size The pending input-limit of a connection, <code>0</code>
+   *             disables the limit.
+   */
+  void setMaxConnectionPendingInput(qint64 size);
+
+  /**
+   * Returns a snapshot of the statistics of the application server.
+   *
+   * The statistics of all worker threads are summed up. In the supervisor of
+   * worker processes (see #setProcessCount()) the statistics are empty, every
+   * worker process maintains statistics of its own.
+   *
+   * Every worker thread takes the snapshot of its own statistics, the method
+   * waits until they are back in their event loop. Don't invoke it on a
+   * worker thread (see #setWorkerCount()), an empty snapshot is returned
+   * there. Use the #statsUpdated() signal instead.
+   *
+   * @return The current statistics
+   */
+  QFCgiStats getStats() const;
+
+  /**
+   * Returns the interval of the #statsUpdated() signal.
+   *
+   * @return The interval in milliseconds
+   * @see setStatsInterval()
+   */
+  int getStatsInterval() const;
+
+  /**
+   * Sets the interval of the #statsUpdated() signal.
+   *
+   * By default the signal is disabled (<code>0</code>).
+   *
+   * @param msecs The interval in milliseconds, <code>0</code> disables the
+   *              signal.
+   */
+  void setStatsInterval(int msecs);
+
   /**
    * Tests whether the #start() operation was successful.
    *
@@ -127,10 +606,21 @@ signals:
    * The library takes over the ownership of the request-object, thus don't
    * destroy the object by yourself.
    *
+   * The signal is emitted on the thread serving the connection, see
+   * #setWorkerCount().
+   *
    * @param request The new request
    */
   void newRequest(QFCgiRequest *request);
 
+  /**
+   * This signal is emitted periodically with the current statistics, see
+   * #setStatsInterval().
+   *
+   * @param stats The current statistics
+   */
+  void statsUpdated(const QFCgiStats &stats);
+
 public slots:
   /**
    * Starts the FastCGI application server.
@@ -141,21 +631,64 @@ public slots:
    * You need to configure the FastCGI application server by calling one of the
    * <code>configureListen</code> methods.
    *
-   * @see configureListen(const QHostAddress &address, quint16 port)
+   * @see configureListen(const QHostAddress &address, quint16 port, enum ListenMode mode)
    * @see configureListen(const QString &path)
    * @see configureListen(enum FileDescriptor fd)
    */
   void start();
 
 private slots:
-  void onNewConnection(QFCgiConnection *connection);
+  void onNewConnection(int descriptor);
+  void onConnectionClosed();
+  void onProcessStarted();
+  void onStatsTimeout();
+  void drain();
 
 private:
   friend class QFCgiConnection;
+  friend class QFCgiMetrics;
+  friend class QFCgiWorker;
 
+  void listen();
+  void listenMetrics();
+  bool admitConnection();
+  void releaseConnection();
+  bool admitRequest();
+  void releaseRequest();
+  void updatePendingInput(qint64 delta);
+  void requestStarted();
   void updateBuilder(QFCgiConnectionBuilder *builder);
+  void startWorkers();
+  void stopWorkers();
 
   QFCgiConnectionBuilder *builder;
+  int readChunkSize;
+  qint64 inputHighWaterMark;
+  qint64 requestInputLimit;
+  qint64 inputSpillThreshold;
+  int workerCount;
+  bool workerListeners;
+  int processCount;
+  int processMaxRequests;
+  int acceptBudget;
+  int outputQuantum;
+  int maxConnections;
+  int maxRequests;
+  int maxConnectionRequests;
+  qint64 maxPendingInput;
+  qint64 maxConnectionPendingInput;
+  QAtomicInt connectionCount;
+  QAtomicInt activeRequests;
+  QMutex pendingInputMutex;
+  qint64 pendingInput;
+  QFCgiSupervisor *supervisor;
+  QAtomicInt requestCount;
+  bool draining;
+  int nextWorker;
+  QList<QFCgiWorker*> workers;
+  QList<QThread*> threads;
+  QTimer *statsTimer;
+  QFCgiMetrics *metrics;
 };
 
 #endif  /* QFCGI_FCGI_H */
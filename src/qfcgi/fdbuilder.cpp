@@ -15,54 +15,24 @@
  * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <QLocalSocket>
-#include <QSocketNotifier>
-
-#include <sys/errno.h>
-#include <sys/socket.h>
-#include <errno.h>
-
-#include "connection.h"
-#include "fcgi.h"
 #include "fdbuilder.h"
 
 QFCgiFdConnectionBuilder::QFCgiFdConnectionBuilder(int fd, QObject *parent)
   : QFCgiConnectionBuilder(parent) {
 
   this->fd = fd;
-  this->notifier = 0;
 }
 
 QFCgiFdConnectionBuilder::~QFCgiFdConnectionBuilder() {
 }
 
 bool QFCgiFdConnectionBuilder::listen() {
-  this->notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
-  connect(this->notifier, SIGNAL(activated(int)), this, SLOT(onActivated(int)));
-  qDebug("FastCGI application started, listening on %d", this->notifier->socket());
+  // the socket is inherited from the web server, it is left open
+  startAccepting(this->fd, false);
+  qDebug("FastCGI application started, listening on %d", this->fd);
   return true;
 }
 
-bool QFCgiFdConnectionBuilder::isListening() const {
-  return (this->notifier != 0);
-}
-
-QString QFCgiFdConnectionBuilder::errorString() const {
-  return "";
-}
-
-void QFCgiFdConnectionBuilder::onActivated(int socket) {
-  int so = accept(socket, 0, 0);
-
-  if (so != -1) {
-    QFCgi *fcgi = qobject_cast<QFCgi*>(parent());
-
-    QLocalSocket *device = new QLocalSocket(this);
-    device->setSocketDescriptor(so, QLocalSocket::ConnectedState, QIODevice::ReadWrite);
-
-    QFCgiConnection *connection = new QFCgiConnection(device, fcgi);
-    emit newConnection(connection);
-  } else {
-    qDebug("accept: %s", strerror(errno));
-  }
+QFCgiConnectionBuilder::SocketType QFCgiFdConnectionBuilder::getSocketType() const {
+  return LocalSocket;
 }
@@ -20,8 +20,6 @@
 
 #include "builder.h"
 
-class QSocketNotifier;
-
 class QFCgiFdConnectionBuilder : public QFCgiConnectionBuilder {
   Q_OBJECT
 
@@ -30,14 +28,9 @@ public:
   virtual ~QFCgiFdConnectionBuilder();
 
   bool listen();
-  bool isListening() const;
-  QString errorString() const;
-
-private slots:
-  void onActivated(int socket);
+  SocketType getSocketType() const;
 
 private:
-  QSocketNotifier *notifier;
   int fd;
 };
 
@@ -15,45 +15,75 @@
  * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <QLocalServer>
-#include <QLocalSocket>
+#include <QDir>
+#include <QFile>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
 
-#include "connection.h"
-#include "fcgi.h"
 #include "localbuilder.h"
 
 QFCgiLocalConnectionBuilder::QFCgiLocalConnectionBuilder(const QString &path, QObject *parent)
   : QFCgiConnectionBuilder(parent) {
 
-  this->server = new QLocalServer(this);
   this->path = path;
 }
 
 QFCgiLocalConnectionBuilder::~QFCgiLocalConnectionBuilder() {
+  close();
 }
 
 bool QFCgiLocalConnectionBuilder::listen() {
-  if (this->server->listen(this->path)) {
-    connect(this->server, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
-    qDebug("FastCGI application started, listening on %s",
-      qPrintable(this->server->fullServerName()));
-    return true;
-  } else {
+  // same as QLocalServer, relative names are placed into the temp-directory
+  QString fullPath = this->path.startsWith("/") ? this->path : QDir::tempPath() + "/" + this->path;
+  QByteArray encodedPath = QFile::encodeName(fullPath);
+  struct sockaddr_un sun;
+
+  if (encodedPath.size() >= (int)sizeof(sun.sun_path)) {
+    setErrorString("path too long");
+    return false;
+  }
+
+  memset(&sun, 0, sizeof(sun));
+  sun.sun_family = AF_UNIX;
+  memcpy(sun.sun_path, encodedPath.constData(), encodedPath.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd == -1) {
+    setErrorString(QString::fromLocal8Bit(strerror(errno)));
     return false;
   }
-}
 
-bool QFCgiLocalConnectionBuilder::isListening() const {
-  return this->server->isListening();
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  if (bind(fd, (struct sockaddr*)&sun, sizeof(sun)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+    setErrorString(QString::fromLocal8Bit(strerror(errno)));
+    ::close(fd);
+    return false;
+  }
+
+  startAccepting(fd, true);
+  this->fullPath = fullPath;
+  qDebug("FastCGI application started, listening on %s", qPrintable(fullPath));
+
+  return true;
 }
 
-QString QFCgiLocalConnectionBuilder::errorString() const {
-  return this->server->errorString();
+void QFCgiLocalConnectionBuilder::close() {
+  QFCgiConnectionBuilder::close();
+
+  // the socket-file is created by listen()
+  if (!this->fullPath.isEmpty()) {
+    QFile::remove(this->fullPath);
+    this->fullPath.clear();
+  }
 }
 
-void QFCgiLocalConnectionBuilder::onNewConnection() {
-  QFCgi *fcgi = qobject_cast<QFCgi*>(parent());
-  QLocalSocket *so = this->server->nextPendingConnection();
-  QFCgiConnection *connection = new QFCgiConnection(so, fcgi);
-  emit newConnection(connection);
+QFCgiConnectionBuilder::SocketType QFCgiLocalConnectionBuilder::getSocketType() const {
+  return LocalSocket;
 }
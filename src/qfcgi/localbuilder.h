@@ -20,8 +20,6 @@
 
 #include "builder.h"
 
-class QLocalServer;
-
 class QFCgiLocalConnectionBuilder : public QFCgiConnectionBuilder {
   Q_OBJECT
 
@@ -30,15 +28,12 @@ public:
   virtual ~QFCgiLocalConnectionBuilder();
 
   bool listen();
-  bool isListening() const;
-  QString errorString() const;
-
-private slots:
-  void onNewConnection();
+  void close();
+  SocketType getSocketType() const;
 
 private:
-  QLocalServer *server;
   QString path;
+  QString fullPath;
 };
 
 #endif  /* QFCGI_LOCAL_BUILDER_H */
@@ -0,0 +1,260 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QLocalSocket>
+#include <QTcpSocket>
+
+#include <unistd.h>
+
+#include "builder.h"
+#include "fcgi.h"
+#include "metrics.h"
+#include "stats.h"
+#include "worker.h"
+
+/*
+ * Maximum size of the HTTP request header, larger requests are dropped.
+ */
+#define MAX_REQUEST_SIZE 8192
+
+/*
+ * Every fourth bucket of a histogram is reported, one per power of two.
+ */
+#define BUCKET_STEP 4
+
+static void appendHeader(QByteArray &ba, const char *name, const char *type, const char *help) {
+  ba.append("# HELP ").append(name).append(' ').append(help).append('\n');
+  ba.append("# TYPE ").append(name).append(' ').append(type).append('\n');
+}
+
+static void appendSample(QByteArray &ba, const char *name, const QByteArray &labels, quint64 value) {
+  ba.append(name).append('{').append(labels).append("} ").append(QByteArray::number(value)).append('\n');
+}
+
+static QByteArray seconds(qint64 usecs) {
+  return QByteArray::number(usecs / 1000000.0, 'g', 9);
+}
+
+QFCgiMetrics::QFCgiMetrics(QFCgi *fcgi, QFCgiConnectionBuilder *builder, QObject *parent) : QObject(parent) {
+  this->fcgi = fcgi;
+  this->builder = builder;
+  this->builder->setParent(this);
+}
+
+QFCgiMetrics::~QFCgiMetrics() {
+}
+
+bool QFCgiMetrics::listen() {
+  if (!this->builder->listen()) {
+    return false;
+  }
+
+  connect(this->builder, SIGNAL(newConnection(int)), this, SLOT(onNewConnection(int)));
+  return true;
+}
+
+bool QFCgiMetrics::isListening() const {
+  return this->builder->isListening();
+}
+
+QString QFCgiMetrics::errorString() const {
+  return this->builder->errorString();
+}
+
+QByteArray QFCgiMetrics::format(const QList<QFCgiStats> &stats, const QList<int> &connections) {
+  static const struct {
+    QFCgiStats::Latency latency;
+    const char *phase;
+  } phases[] = {
+    { QFCgiStats::ParamsLatency, "params" },
+    { QFCgiStats::ResponseLatency, "response" },
+    { QFCgiStats::TotalLatency, "total" }
+  };
+
+  QList<QByteArray> labels;
+  QByteArray ba;
+
+  for (int i = 0; i < stats.size(); i++) {
+    labels.append(QByteArray("worker=\"").append(QByteArray::number(i)).append('"'));
+  }
+
+#define COUNTER(name, help, getter) \
+  appendHeader(ba, name, "counter", help); \
+  for (int i = 0; i < stats.size(); i++) { \
+    appendSample(ba, name, labels.at(i), stats.at(i).getter()); \
+  }
+
+  COUNTER("qfcgi_connections_accepted_total", "Connections accepted from the web server.", getAcceptedConnections);
+  COUNTER("qfcgi_connections_closed_total", "Connections closed.", getClosedConnections);
+  COUNTER("qfcgi_requests_started_total", "Requests passed to the application.", getStartedRequests);
+  COUNTER("qfcgi_requests_completed_total", "Requests ended by the application.", getCompletedRequests);
+  COUNTER("qfcgi_requests_rejected_total", "Requests rejected by the application server.", getRejectedRequests);
+  COUNTER("qfcgi_requests_aborted_total", "Requests aborted by the web server.", getAbortedRequests);
+  COUNTER("qfcgi_bytes_in_total", "Bytes read from the web server.", getBytesIn);
+  COUNTER("qfcgi_bytes_out_total", "Bytes written to the web server.", getBytesOut);
+  COUNTER("qfcgi_parse_errors_total", "Connections closed because of an invalid record.", getParseErrors);
+
+#undef COUNTER
+
+  appendHeader(ba, "qfcgi_connections_open", "gauge", "Connections currently served.");
+  for (int i = 0; i < stats.size(); i++) {
+    appendSample(ba, "qfcgi_connections_open", labels.at(i), connections.value(i));
+  }
+
+  appendHeader(ba, "qfcgi_requests_active", "gauge", "Requests started and not yet ended.");
+  for (int i = 0; i < stats.size(); i++) {
+    appendSample(ba, "qfcgi_requests_active", labels.at(i), stats.at(i).getActiveRequests());
+  }
+
+  appendHeader(ba, "qfcgi_records_total", "counter", "Records read from the web server by type.");
+  for (int i = 0; i < stats.size(); i++) {
+    for (int type = 1; type < QFCgiStats::NUM_RECORD_TYPES; type++) {
+      QByteArray typeLabels = labels.at(i) + ",type=\"" + QByteArray::number(type) + "\"";
+      appendSample(ba, "qfcgi_records_total", typeLabels, stats.at(i).getRecordCount(type));
+    }
+  }
+
+  appendHeader(ba, "qfcgi_request_duration_seconds", "histogram", "Latency of the phases of a request.");
+  for (int i = 0; i < stats.size(); i++) {
+    for (unsigned int p = 0; p < sizeof(phases) / sizeof(phases[0]); p++) {
+      const QFCgiStats &s = stats.at(i);
+      QByteArray phaseLabels = labels.at(i) + ",phase=\"" + phases[p].phase + "\"";
+      quint64 count = 0;
+
+      for (int b = 0; b < QFCgiStats::NUM_BUCKETS; b++) {
+        count += s.getLatencyBucket(phases[p].latency, b);
+
+        if (b % BUCKET_STEP == BUCKET_STEP - 1) {
+          // the buckets are cumulative
+          QByteArray le = phaseLabels + ",le=\"" + seconds(QFCgiStats::getBucketUpperBound(b)) + "\"";
+          appendSample(ba, "qfcgi_request_duration_seconds_bucket", le, count);
+        }
+      }
+
+      appendSample(ba, "qfcgi_request_duration_seconds_bucket", phaseLabels + ",le=\"+Inf\"", count);
+      ba.append("qfcgi_request_duration_seconds_sum{").append(phaseLabels).append("} ")
+        .append(seconds(s.getLatencySum(phases[p].latency))).append('\n');
+      appendSample(ba, "qfcgi_request_duration_seconds_count", phaseLabels, count);
+    }
+  }
+
+  return ba;
+}
+
+void QFCgiMetrics::onNewConnection(int descriptor) {
+  QIODevice *device;
+  bool valid;
+
+  if (this->builder->getSocketType() == QFCgiConnectionBuilder::TcpSocket) {
+    QTcpSocket *so = new QTcpSocket(this);
+    valid = so->setSocketDescriptor(descriptor);
+    device = so;
+  } else {
+    QLocalSocket *so = new QLocalSocket(this);
+    valid = so->setSocketDescriptor(descriptor, QLocalSocket::ConnectedState, QIODevice::ReadWrite);
+    device = so;
+  }
+
+  if (!valid) {
+    qDebug("failed to take over metrics socket %d: %s", descriptor, qPrintable(device->errorString()));
+    delete device;
+    ::close(descriptor);
+    return;
+  }
+
+  this->pending.insert(device, QByteArray());
+
+  connect(device, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+  connect(device, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+}
+
+void QFCgiMetrics::onReadyRead() {
+  QIODevice *device = qobject_cast<QIODevice*>(sender());
+
+  if (device == 0 || !this->pending.contains(device)) {
+    return;
+  }
+
+  QByteArray &request = this->pending[device];
+  request.append(device->readAll());
+
+  int end = request.indexOf("\r\n\r\n");
+
+  if (end == -1) {
+    end = request.indexOf("\n\n");
+  }
+
+  if (end == -1) {
+    if (request.size() > MAX_REQUEST_SIZE) {
+      qDebug("metrics request too large");
+      this->pending.remove(device);
+      device->close();
+      device->deleteLater();
+    }
+    return;
+  }
+
+  QByteArray requestLine = request.left(request.indexOf('\n')).trimmed();
+  this->pending.remove(device);
+
+  respond(device, requestLine);
+}
+
+void QFCgiMetrics::onDisconnected() {
+  QIODevice *device = qobject_cast<QIODevice*>(sender());
+
+  if (device != 0) {
+    this->pending.remove(device);
+    device->deleteLater();
+  }
+}
+
+void QFCgiMetrics::respond(QIODevice *device, const QByteArray &requestLine) {
+  QList<QByteArray> parts = requestLine.split(' ');
+  QByteArray status;
+  QByteArray body;
+
+  if (parts.size() < 2 || (parts.at(0) != "GET" && parts.at(0) != "HEAD")) {
+    status = "405 Method Not Allowed";
+  } else if (parts.at(1) != "/metrics" && parts.at(1) != "/") {
+    status = "404 Not Found";
+  } else {
+    QList<QFCgiStats> stats;
+    QList<int> connections;
+
+    Q_FOREACH(QFCgiWorker *worker, this->fcgi->workers) {
+      stats.append(worker->getStats());
+      connections.append(worker->getConnectionCount());
+    }
+
+    status = "200 OK";
+    body = format(stats, connections);
+  }
+
+  QByteArray response = "HTTP/1.0 " + status + "\r\n";
+  response.append("Content-Type: text/plain; version=0.0.4\r\n");
+  response.append("Content-Length: ").append(QByteArray::number(body.size())).append("\r\n");
+  response.append("Connection: close\r\n\r\n");
+
+  if (parts.value(0) != "HEAD") {
+    response.append(body);
+  }
+
+  // the socket sends the response, before it is closed
+  device->write(response);
+  device->close();
+}
@@ -0,0 +1,62 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QFCGI_METRICS_H
+#define QFCGI_METRICS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QObject>
+
+class QFCgi;
+class QFCgiConnectionBuilder;
+class QFCgiStats;
+class QIODevice;
+
+/*
+ * Serves the statistics of the workers in the Prometheus text format over
+ * HTTP. Connections are accepted by a QFCgiConnectionBuilder, every request
+ * is answered on its own connection, which is closed afterwards.
+ */
+class QFCgiMetrics : public QObject {
+  Q_OBJECT
+
+public:
+  QFCgiMetrics(QFCgi *fcgi, QFCgiConnectionBuilder *builder, QObject *parent = 0);
+  virtual ~QFCgiMetrics();
+
+  bool listen();
+  bool isListening() const;
+  QString errorString() const;
+
+  static QByteArray format(const QList<QFCgiStats> &stats, const QList<int> &connections);
+
+private slots:
+  void onNewConnection(int descriptor);
+  void onReadyRead();
+  void onDisconnected();
+
+private:
+  void respond(QIODevice *device, const QByteArray &requestLine);
+
+  QFCgi *fcgi;
+  QFCgiConnectionBuilder *builder;
+  QHash<QIODevice*, QByteArray> pending;
+};
+
+#endif  /* QFCGI_METRICS_H */
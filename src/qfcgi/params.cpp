@@ -0,0 +1,326 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "params.h"
+
+/*
+ * Block size of the arena, large enough for the parameters sent by common
+ * web servers.
+ */
+#define ARENA_SIZE 2048
+
+/*
+ * Number of pairs reserved up front.
+ */
+#define ENTRIES_SIZE 64
+
+/*
+ * Largest pair accepted, including its length fields. A pair split across
+ * records is collected up to this size.
+ */
+#define MAX_PAIR_SIZE (1024 * 1024)
+
+#define PARAM(name) { #name, sizeof(#name) - 1 }
+
+/*
+ * Names of the well-known parameters, in the order of QFCgiRequest::Param.
+ */
+static const struct {
+  const char *name;
+  int length;
+} wellKnownParams[] = {
+  PARAM(AUTH_TYPE),
+  PARAM(CONTENT_LENGTH),
+  PARAM(CONTENT_TYPE),
+  PARAM(DOCUMENT_ROOT),
+  PARAM(DOCUMENT_URI),
+  PARAM(GATEWAY_INTERFACE),
+  PARAM(HTTPS),
+  PARAM(HTTP_ACCEPT),
+  PARAM(HTTP_ACCEPT_ENCODING),
+  PARAM(HTTP_ACCEPT_LANGUAGE),
+  PARAM(HTTP_AUTHORIZATION),
+  PARAM(HTTP_CONNECTION),
+  PARAM(HTTP_COOKIE),
+  PARAM(HTTP_HOST),
+  PARAM(HTTP_REFERER),
+  PARAM(HTTP_USER_AGENT),
+  PARAM(HTTP_X_FORWARDED_FOR),
+  PARAM(PATH_INFO),
+  PARAM(PATH_TRANSLATED),
+  PARAM(QUERY_STRING),
+  PARAM(REDIRECT_STATUS),
+  PARAM(REMOTE_ADDR),
+  PARAM(REMOTE_HOST),
+  PARAM(REMOTE_PORT),
+  PARAM(REMOTE_USER),
+  PARAM(REQUEST_METHOD),
+  PARAM(REQUEST_SCHEME),
+  PARAM(REQUEST_URI),
+  PARAM(SCRIPT_FILENAME),
+  PARAM(SCRIPT_NAME),
+  PARAM(SERVER_ADDR),
+  PARAM(SERVER_NAME),
+  PARAM(SERVER_PORT),
+  PARAM(SERVER_PROTOCOL),
+  PARAM(SERVER_SOFTWARE)
+};
+
+// the table needs an entry for every QFCgiRequest::Param
+typedef char wellKnownParamsComplete[
+  (sizeof(wellKnownParams) / sizeof(wellKnownParams[0]) == QFCgiParams::NUM_WELL_KNOWN) ? 1 : -1];
+
+QFCgiParams::QFCgiParams() : arena(ARENA_SIZE) {
+  // a reserved vector keeps its capacity, when it is cleared
+  this->entries.reserve(ENTRIES_SIZE);
+  clear();
+}
+
+bool QFCgiParams::consume(const char *data, int size) {
+  while (!this->pending.isEmpty() && size > 0) {
+    // Complete the pair started in the previous record. Take over just the
+    // missing bytes, the rest is decoded in place.
+    qint64 npair = pendingPairSize();
+
+    if (npair > MAX_PAIR_SIZE) {
+      return false;
+    }
+
+    qint32 nmissing = (npair > 0) ? npair - this->pending.size() : 1;
+    qint32 n = qMin(nmissing, size);
+
+    this->pending.append(data, n);
+    data += n;
+    size -= n;
+
+    if (n == nmissing && npair > 0) {
+      decode(this->pending.constData(), this->pending.size());
+      this->pending.clear();
+    }
+  }
+
+  if (size > 0) {
+    qint32 nread = decode(data, size);
+    this->pending.append(data + nread, size - nread);
+  }
+
+  // the peer declared a pair, which is never collected
+  return pendingPairSize() <= MAX_PAIR_SIZE;
+}
+
+void QFCgiParams::clear() {
+  this->pending.clear();
+  this->arena.reset();
+  this->entries.resize(0);
+  this->index.clear();
+  this->indexed = false;
+
+  for (int i = 0; i < NUM_WELL_KNOWN; i++) {
+    this->wellKnown[i] = -1;
+  }
+}
+
+int QFCgiParams::count() const {
+  int n = 0;
+
+  for (int i = 0; i < this->entries.size(); i++) {
+    const Entry &e = this->entries.at(i);
+
+    if (find(e.name, e.nameLength) == i) {
+      n++;
+    }
+  }
+
+  return n;
+}
+
+QList<QString> QFCgiParams::names() const {
+  QList<QString> list;
+
+  for (int i = 0; i < this->entries.size(); i++) {
+    const Entry &e = this->entries.at(i);
+
+    // a duplicate name is listed once, the last pair wins
+    if (find(e.name, e.nameLength) == i) {
+      list.append(QString::fromAscii(e.name, e.nameLength));
+    }
+  }
+
+  return list;
+}
+
+QString QFCgiParams::value(const QString &name) const {
+  QByteArray ba = name.toAscii();
+  QByteArray value = valueAt(find(ba.constData(), ba.size()));
+
+  return QString::fromAscii(value.constData(), value.size());
+}
+
+QByteArray QFCgiParams::rawValue(const char *name, int length) const {
+  return valueAt(find(name, length));
+}
+
+QByteArray QFCgiParams::rawValue(enum QFCgiRequest::Param param) const {
+  return valueAt(this->wellKnown[param]);
+}
+
+int QFCgiParams::wellKnownParam(const char *name, int length) {
+  int lo = 0;
+  int hi = NUM_WELL_KNOWN - 1;
+
+  // binary search, the table is ordered by name
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    int cmp = memcmp(wellKnownParams[mid].name, name, qMin(wellKnownParams[mid].length, length));
+
+    if (cmp == 0) {
+      cmp = wellKnownParams[mid].length - length;
+    }
+
+    if (cmp == 0) {
+      return mid;
+    } else if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  return -1;
+}
+
+qint32 QFCgiParams::decode(const char *data, qint32 size) {
+  qint32 pos = 0;
+
+  while (pos < size) {
+    quint32 nameLength, valueLength;
+    qint32 nheader = readPairLength(data + pos, size - pos, &nameLength, &valueLength);
+
+    if (nheader <= 0 || (quint32)(size - pos - nheader) < nameLength + valueLength) {
+      break;
+    }
+
+    const char *name = data + pos + nheader;
+    const char *value = name + nameLength;
+
+    insert(name, nameLength, value, valueLength);
+    pos += nheader + nameLength + valueLength;
+  }
+
+  return pos;
+}
+
+void QFCgiParams::insert(const char *name, int nameLength, const char *value, int valueLength) {
+  Entry e;
+  char *data = this->arena.allocate(nameLength + valueLength);
+
+  memcpy(data, name, nameLength);
+  memcpy(data + nameLength, value, valueLength);
+
+  e.name = data;
+  e.nameLength = nameLength;
+  e.value = data + nameLength;
+  e.valueLength = valueLength;
+
+  this->entries.append(e);
+
+  int param = wellKnownParam(name, nameLength);
+
+  if (param >= 0) {
+    this->wellKnown[param] = this->entries.size() - 1;
+  } else if (this->indexed) {
+    // the arena does not move, the keys of the index stay valid
+    this->index.insert(QByteArray::fromRawData(e.name, e.nameLength), this->entries.size() - 1);
+  }
+}
+
+int QFCgiParams::find(const char *name, int length) const {
+  int param = wellKnownParam(name, length);
+
+  if (param >= 0) {
+    return this->wellKnown[param];
+  }
+
+  if (!this->indexed) {
+    this->indexed = true;
+
+    for (int i = 0; i < this->entries.size(); i++) {
+      const Entry &e = this->entries.at(i);
+
+      if (wellKnownParam(e.name, e.nameLength) < 0) {
+        // later pairs replace earlier ones with the same name
+        this->index.insert(QByteArray::fromRawData(e.name, e.nameLength), i);
+      }
+    }
+  }
+
+  return this->index.value(QByteArray::fromRawData(name, length), -1);
+}
+
+QByteArray QFCgiParams::valueAt(int idx) const {
+  if (idx >= 0) {
+    const Entry &e = this->entries.at(idx);
+    return QByteArray::fromRawData(e.value, e.valueLength);
+  } else {
+    return QByteArray();
+  }
+}
+
+qint64 QFCgiParams::pendingPairSize() const {
+  quint32 nameLength, valueLength;
+  qint32 nheader = readPairLength(this->pending.constData(), this->pending.size(), &nameLength, &valueLength);
+
+  return (nheader > 0) ? (qint64)nheader + nameLength + valueLength : 0;
+}
+
+qint32 QFCgiParams::readPairLength(const char *data, qint32 size, quint32 *nameLength, quint32 *valueLength) {
+  qint32 nnl, nvl;
+
+  if ((nnl = readLengthField(data, size, nameLength)) <= 0) {
+    return nnl;
+  }
+
+  if ((nvl = readLengthField(data + nnl, size - nnl, valueLength)) <= 0) {
+    return nvl;
+  }
+
+  return nnl + nvl;
+}
+
+qint32 QFCgiParams::readLengthField(const char *data, qint32 size, quint32 *length) {
+  if (size < 1) {
+    return 0;
+  }
+
+  if ((data[0] & 0x80) == 0) {
+    *length = data[0] & 0xFF;
+    return 1;
+  }
+
+  if (size < 4) {
+    return 0;
+  }
+
+  *length = ((data[0] & 0x7F) << 24) |
+            ((data[1] & 0xFF) << 16) |
+            ((data[2] & 0xFF) << 8) |
+            (data[3] & 0xFF);
+
+  return 4;
+}
@@ -0,0 +1,84 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QFCGI_PARAMS_H
+#define QFCGI_PARAMS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include "arena.h"
+#include "request.h"
+
+/*
+ * Decoder and storage for the name-value pairs of a FCGI_PARAMS stream.
+ *
+ * The pairs are decoded in a single pass directly from the record content.
+ * Only a pair split across two records is copied, and only once.
+ *
+ * Names and values are kept as raw bytes in an arena, which keeps its memory
+ * when the parameters are #clear()ed for the next request. Conversion to
+ * QString happens only for pairs actually requested.
+ *
+ * Well-known names (QFCgiRequest::Param) are recognized while decoding and
+ * stored in a slot per name. Other names are found through a hash, which is
+ * built on the first lookup.
+ */
+class QFCgiParams {
+public:
+  QFCgiParams();
+
+  bool consume(const char *data, int size);
+  void clear();
+
+  int count() const;
+  QList<QString> names() const;
+  QString value(const QString &name) const;
+  QByteArray rawValue(const char *name, int length) const;
+  QByteArray rawValue(enum QFCgiRequest::Param param) const;
+
+  static int wellKnownParam(const char *name, int length);
+  static const int NUM_WELL_KNOWN = QFCgiRequest::SERVER_SOFTWARE + 1;
+
+private:
+  struct Entry {
+    const char *name;
+    int nameLength;
+    const char *value;
+    int valueLength;
+  };
+
+  qint32 decode(const char *data, qint32 size);
+  qint64 pendingPairSize() const;
+  void insert(const char *name, int nameLength, const char *value, int valueLength);
+  int find(const char *name, int length) const;
+  QByteArray valueAt(int idx) const;
+  static qint32 readPairLength(const char *data, qint32 size, quint32 *nameLength, quint32 *valueLength);
+  static qint32 readLengthField(const char *data, qint32 size, quint32 *length);
+
+  QByteArray pending;
+  QFCgiArena arena;
+  QVector<Entry> entries;
+  int wellKnown[NUM_WELL_KNOWN];
+  mutable QHash<QByteArray, int> index;
+  mutable bool indexed;
+};
+
+#endif  /* QFCGI_PARAMS_H */
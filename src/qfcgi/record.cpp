@@ -19,26 +19,24 @@
 
 #include "record.h"
 
-/*
- * Number of bytes in a FCGI_Header. Future versions of the protocol
- * will not reduce this number.
- */
-#define FCGI_HEADER_LEN 8
-
 /*
  * Value for version component of FCGI_Header
  */
 #define FCGI_VERSION_1 1
 
+static const char padding[FCGI_HEADER_LEN] = { 0 };
+
 QFCgiRecord::QFCgiRecord() {
   this->version = QFCgiRecord::V1;
   this->type = FCGI_UNKNOWN_TYPE;
+  this->rawType = FCGI_UNKNOWN_TYPE;
   this->requestId = 0;
 }
 
 QFCgiRecord::QFCgiRecord(const QFCgiRecord &other) {
   this->version = other.version;
   this->type = other.type;
+  this->rawType = other.rawType;
   this->requestId = other.requestId;
   this->content = other.content;
 }
@@ -46,12 +44,54 @@ QFCgiRecord::QFCgiRecord(const QFCgiRecord &other) {
 QFCgiRecord& QFCgiRecord::operator = (const QFCgiRecord &other) {
   this->version = other.version;
   this->type = other.type;
+  this->rawType = other.rawType;
   this->requestId = other.requestId;
   this->content = other.content;
 
   return *this;
 }
 
+QFCgiRecord QFCgiRecord::createBeginRequest(quint32 requestId, quint16 role, bool keepConn) {
+  const char reserved[] = { 0, 0, 0, 0, 0 };
+
+  QFCgiRecord record;
+  record.type = FCGI_BEGIN_REQUEST;
+  record.requestId = requestId;
+
+  record.content
+    .append((role >> 8) & 0xFF)
+    .append(role & 0xFF)
+    .append((char)(keepConn ? FCGI_KEEP_CONN : 0))
+    .append(reserved, sizeof(reserved));
+
+  return record;
+}
+
+QFCgiRecord QFCgiRecord::createParams(quint32 requestId, const QList<QPair<QByteArray, QByteArray> > &params) {
+  QFCgiRecord record;
+
+  record.type = FCGI_PARAMS;
+  record.requestId = requestId;
+
+  for (int i = 0; i < params.size(); i++) {
+    appendLength(record.content, params.at(i).first.size());
+    appendLength(record.content, params.at(i).second.size());
+    record.content.append(params.at(i).first).append(params.at(i).second);
+  }
+
+  return record;
+}
+
+QFCgiRecord QFCgiRecord::createInStream(quint32 requestId, const QByteArray &data) {
+  QFCgiRecord record;
+
+  record.type = FCGI_STDIN;
+  record.requestId = requestId;
+  record.content = data;
+
+  return record;
+}
+
 QFCgiRecord QFCgiRecord::createEndRequest(quint32 requestId, quint32 appStatus, enum ProtocolStatus protocolStatus) {
   const char reserved[] = { 0, 0, 0 };
 
@@ -100,6 +140,35 @@ QFCgiRecord QFCgiRecord::createDataStream(quint32 requestId, const QByteArray &d
   return record;
 }
 
+QFCgiRecord QFCgiRecord::createGetValuesResult(const QList<QPair<QByteArray, QByteArray> > &values) {
+  QFCgiRecord record;
+
+  record.type = FCGI_GET_VALUES_RESULT;
+  record.requestId = 0;
+
+  for (int i = 0; i < values.size(); i++) {
+    appendLength(record.content, values.at(i).first.size());
+    appendLength(record.content, values.at(i).second.size());
+    record.content.append(values.at(i).first).append(values.at(i).second);
+  }
+
+  return record;
+}
+
+QFCgiRecord QFCgiRecord::createUnknownType(quint8 type) {
+  const char reserved[] = { 0, 0, 0, 0, 0, 0, 0 };
+
+  QFCgiRecord record;
+  record.type = FCGI_UNKNOWN_TYPE;
+  record.requestId = 0;
+
+  record.content
+    .append(type)
+    .append(reserved, sizeof(reserved));
+
+  return record;
+}
+
 enum QFCgiRecord::Version QFCgiRecord::getVersion() const {
   return this->version;
 }
@@ -117,15 +186,35 @@ enum QFCgiRecord::Type QFCgiRecord::getType() const {
   return this->type;
 }
 
+quint8 QFCgiRecord::getRawType() const {
+  return this->rawType;
+}
+
 void QFCgiRecord::setType(QFCgiRecord::Type type) {
   this->type = type;
+  this->rawType = type;
+}
+
+void QFCgiRecord::appendLength(QByteArray &ba, int length) {
+  if (length < 128) {
+    ba.append(length);
+  } else {
+    ba.append(((length >> 24) & 0x7F) | 0x80)
+      .append((length >> 16) & 0xFF)
+      .append((length >> 8) & 0xFF)
+      .append(length & 0xFF);
+  }
 }
 
 bool QFCgiRecord::setType(quint8 type) {
+  this->rawType = type;
+
   if (type > 0 && type <= FCGI_UNKNOWN_TYPE) {
     this->type = (enum Type)type;
     return true;
   } else {
+    // only the raw type is kept, see getRawType()
+    this->type = FCGI_UNKNOWN_TYPE;
     return false;
   }
 }
@@ -143,20 +232,32 @@ const QByteArray& QFCgiRecord::getContent() const {
 }
 
 qint32 QFCgiRecord::read(const QByteArray &ba) {
+  qint32 nread = read(ba.constData(), ba.size());
+
+  if (nread > 0) {
+    // the caller owns ba, detach from it
+    this->content = QByteArray(this->content.constData(), this->content.size());
+  }
+
+  return nread;
+}
+
+qint32 QFCgiRecord::read(const char *data, qint32 size) {
   quint16 contentLength;
   quint8 paddingLength;
 
-  qint32 nread = readHeader(ba, &contentLength, &paddingLength);
+  qint32 nread = readHeader(data, size, &contentLength, &paddingLength);
 
   if (nread <= 0) {
     return nread;
   }
 
-  if (ba.size() < nread + contentLength + paddingLength) {
+  if (size < nread + contentLength + paddingLength) {
     return 0;
   }
 
-  this->content = ba.mid(nread, contentLength);
+  // no copy, the content refers to the data of the caller
+  this->content = QByteArray::fromRawData(data + nread, contentLength);
 
   // don't read padding but skip it
   return nread + contentLength + paddingLength;
@@ -168,52 +269,66 @@ qint32 QFCgiRecord::write(QIODevice *device) const {
 
   nwritten = writeHeader(device, &paddingLength);
   device->write(this->content);
-
-  QByteArray padding(paddingLength, 0);
-  device->write(padding);
+  device->write(padding, paddingLength);
 
   return nwritten + this->content.size() + paddingLength;
 }
 
-qint32 QFCgiRecord::readHeader(const QByteArray &ba, quint16 *contentLength, quint8 *paddingLength) {
-  if (ba.size() < FCGI_HEADER_LEN) {
+quint8 QFCgiRecord::encodeHeader(char *header) const {
+  return encodeHeader(header, this->content.size());
+}
+
+quint8 QFCgiRecord::encodeHeader(char *header, quint16 contentLength) const {
+  int mod = contentLength % FCGI_HEADER_LEN;
+  quint8 paddingLength = (mod > 0) ? FCGI_HEADER_LEN - mod : 0;
+
+  header[0] = FCGI_VERSION_1;
+  header[1] = this->type;
+  header[2] = (this->requestId >> 8) & 0xFF;
+  header[3] = this->requestId & 0xFF;
+  header[4] = (contentLength >> 8) & 0xFF;
+  header[5] = contentLength & 0xFF;
+  header[6] = paddingLength;
+  header[7] = 0; // reserved
+
+  return paddingLength;
+}
+
+const char* QFCgiRecord::getPadding() {
+  return padding;
+}
+
+qint32 QFCgiRecord::readHeader(const char *data, qint32 size, quint16 *contentLength, quint8 *paddingLength) {
+  if (size < FCGI_HEADER_LEN) {
     // Not enough data available
     return 0;
   }
 
-  if (!setVersion(ba[0] & 0xFF)) {
+  if (!setVersion(data[0] & 0xFF)) {
     return -1;
   }
 
-  if (!setType(ba[1] & 0xFF)) {
+  this->requestId = ((data[2] & 0xFF) << 8) | (data[3] & 0xFF);
+
+  // a management record of an unknown type is answered with
+  // FCGI_UNKNOWN_TYPE
+  if (!setType(data[1] & 0xFF) && this->requestId != 0) {
     return -1;
   }
 
-  this->requestId = ((ba[2] & 0xFF) << 8) | (ba[3] & 0xFF);
+  *contentLength = ((data[4] & 0xFF) << 8) | (data[5] & 0xFF);
+  *paddingLength = data[6] & 0xFF;
 
-  *contentLength = ((ba[4] & 0xFF) << 8) | (ba[5] & 0xFF);
-  *paddingLength = ba[6] & 0xFF;
-
-  // ba[7] -> reserved-flag
+  // data[7] -> reserved-flag
 
   return FCGI_HEADER_LEN;
 }
 
 qint32 QFCgiRecord::writeHeader(QIODevice *device, quint8 *paddingLength) const {
-  int contentLength = this->content.size();
-  int reserved = 0;
+  char header[FCGI_HEADER_LEN];
 
-  int mod = contentLength % FCGI_HEADER_LEN;
-  *paddingLength = (mod > 0) ? FCGI_HEADER_LEN - mod : 0;
-
-  QByteArray header;
-  header.append(FCGI_VERSION_1)
-    .append(this->type)
-    .append((this->requestId >> 8) & 0xFF).append(this->requestId & 0xFF)
-    .append((contentLength >> 8) & 0xFF).append(contentLength & 0xFF)
-    .append(*paddingLength & 0xFF)
-    .append(reserved);
-  device->write(header);
+  *paddingLength = encodeHeader(header);
+  device->write(header, FCGI_HEADER_LEN);
 
   return FCGI_HEADER_LEN;
 }
@@ -19,10 +19,35 @@
 #define QFCGI_RECORD_H
 
 #include <QByteArray>
+#include <QList>
+#include <QPair>
 #include <QtGlobal>
 
 class QIODevice;
 
+/*
+ * Number of bytes in a FCGI_Header. Future versions of the protocol
+ * will not reduce this number.
+ */
+#define FCGI_HEADER_LEN 8
+
+/*
+ * Largest content-length of a record, which needs no padding.
+ */
+#define MAX_ALIGNED_CONTENT_LENGTH 65528
+
+/*
+ * Values for role component of FCGI_BeginRequestBody
+ */
+#define FCGI_RESPONDER  1
+#define FCGI_AUTHORIZER 2
+#define FCGI_FILTER     3
+
+/*
+ * Mask for flags component of FCGI_BeginRequestBody
+ */
+#define FCGI_KEEP_CONN  1
+
 class QFCgiRecord {
 public:
   enum Version {
@@ -53,32 +78,46 @@ public:
   QFCgiRecord();
   QFCgiRecord(const QFCgiRecord &other);
 
+  static QFCgiRecord createBeginRequest(quint32 requestId, quint16 role, bool keepConn);
+  static QFCgiRecord createParams(quint32 requestId, const QList<QPair<QByteArray, QByteArray> > &params);
+  static QFCgiRecord createInStream(quint32 requestId, const QByteArray &data);
   static QFCgiRecord createEndRequest(quint32 requestId, quint32 appStatus, enum ProtocolStatus protocolStatus);
   static QFCgiRecord createOutStream(quint32 requestId, const QByteArray &data);
   static QFCgiRecord createErrStream(quint32 requestId, const QByteArray &data);
   static QFCgiRecord createDataStream(quint32 requestId, const QByteArray &data);
+  static QFCgiRecord createGetValuesResult(const QList<QPair<QByteArray, QByteArray> > &values);
+  static QFCgiRecord createUnknownType(quint8 type);
 
   QFCgiRecord& operator = (const QFCgiRecord &other);
 
   enum Version getVersion() const;
   enum Type getType() const;
+  quint8 getRawType() const;
   void setType(Type type);
   quint16 getRequestId() const;
   void setRequestId(quint16 requestId);
   const QByteArray& getContent() const;
 
   qint32 read(const QByteArray &ba);
+  qint32 read(const char *data, qint32 size);
   qint32 write(QIODevice *device) const;
 
+  quint8 encodeHeader(char *header) const;
+  quint8 encodeHeader(char *header, quint16 contentLength) const;
+  static const char* getPadding();
+
 private:
+  static void appendLength(QByteArray &ba, int length);
+
   bool setVersion(quint8 version);
   bool setType(quint8 type);
 
-  qint32 readHeader(const QByteArray &ba, quint16 *contentLength, quint8 *paddingLength);
+  qint32 readHeader(const char *data, qint32 size, quint16 *contentLength, quint8 *paddingLength);
   qint32 writeHeader(QIODevice *device, quint8 *paddingLength) const;
 
   enum Version version;
   enum Type type;
+  quint8 rawType;
   quint16 requestId;
   QByteArray content;
 };
@@ -16,28 +16,42 @@
  */
 
 #include <QBuffer>
+#include <QFile>
 #include <QtGlobal>
 
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
 #include "connection.h"
+#include "params.h"
 #include "record.h"
 #include "request.h"
 #include "stream.h"
 
 #define q2Debug(format, args...) qDebug("[%d] " format, this->id, ##args)
 
+static QFCgiRecord createStreamRecord(QFCgiRecord::Type type, int id, const QByteArray &data) {
+  if (type == QFCgiRecord::FCGI_STDOUT) {
+    return QFCgiRecord::createOutStream(id, data);
+  } else {
+    return QFCgiRecord::createErrStream(id, data);
+  }
+}
+
 QFCgiRequest::QFCgiRequest(int id, bool keepConn, QFCgiConnection *parent) : QObject(parent) {
-  this->id = id;
-  this->keepConn = keepConn;
+  this->params = new QFCgiParams;
   this->in = new QFCgiStream(this);
   this->out = new QFCgiStream(this);
   this->err = new QFCgiStream(this);
 
-  this->in->open(QIODevice::ReadOnly);
-  this->out->open(QIODevice::WriteOnly);
-  this->err->open(QIODevice::WriteOnly);
+  reset(id, keepConn);
+}
 
-  connect(this->out, SIGNAL(bytesWritten(qint64)), this, SLOT(onOutBytesWritten(qint64)));
-  connect(this->err, SIGNAL(bytesWritten(qint64)), this, SLOT(onErrBytesWritten(qint64)));
+QFCgiRequest::~QFCgiRequest() {
+  delete this->params;
 }
 
 int QFCgiRequest::getId() const {
@@ -51,9 +65,41 @@ bool QFCgiRequest::keepConnection() const {
 void QFCgiRequest::endRequest(quint32 appStatus) {
   QFCgiConnection *connection = qobject_cast<QFCgiConnection*>(parent());
 
+  if (this->ended) {
+    if (this->abortEnded) {
+      // the application is done with the aborted request
+      this->abortEnded = false;
+      connection->releaseAbortedRequest(this);
+    } else {
+      q2Debug("endRequest - request already ended");
+    }
+    return;
+  }
+
+  this->ended = true;
+
+  // unread input-data are discarded, they must not block the connection
+  this->in->close();
+
+  if (this->abortFlag) {
+    // nobody reads the output of an aborted request
+    this->out->getBuffer().clear();
+    this->err->getBuffer().clear();
+  } else {
+    flush();
+  }
+
   connection->send(QFCgiRecord::createOutStream(this->id, QByteArray()));
   connection->send(QFCgiRecord::createErrStream(this->id, QByteArray()));
   connection->send(QFCgiRecord::createEndRequest(this->id, appStatus, QFCgiRecord::FCGI_REQUEST_COMPLETE));
+  connection->requestEnded(this);
+
+  if (this->abortEnded) {
+    // The request is deleted with its connection, but the application still
+    // holds the aborted request. The connection is closed, once the
+    // application ends the request as well.
+    return;
+  }
 
   if (!keepConnection()) {
     q2Debug("endRequest - about to close connection");
@@ -62,17 +108,34 @@ void QFCgiRequest::endRequest(quint32 appStatus) {
 }
 
 QList<QString> QFCgiRequest::getParams() const {
-  return this->params.keys();
+  return this->params->names();
 }
 
 QString QFCgiRequest::getParam(const QString &name) const {
-  return this->params.value(name);
+  return this->params->value(name);
+}
+
+QByteArray QFCgiRequest::getParamRaw(const QByteArray &name) const {
+  return this->params->rawValue(name.constData(), name.size());
+}
+
+QString QFCgiRequest::getParam(enum Param param) const {
+  QByteArray ba = getParamRaw(param);
+  return QString::fromAscii(ba.constData(), ba.size());
+}
+
+QByteArray QFCgiRequest::getParamRaw(enum Param param) const {
+  return this->params->rawValue(param);
 }
 
 QIODevice* QFCgiRequest::getIn() const {
   return this->in;
 }
 
+int QFCgiRequest::getInFileDescriptor() const {
+  return this->in->fileDescriptor();
+}
+
 QIODevice* QFCgiRequest::getOut() const {
   return this->out;
 }
@@ -81,95 +144,171 @@ QIODevice* QFCgiRequest::getErr() const {
   return this->err;
 }
 
-void QFCgiRequest::onOutBytesWritten(qint64 bytes __unused) {
-  QByteArray &ba = this->out->getBuffer();
-  int nbytes = qMin(65535, ba.size());
-
+bool QFCgiRequest::sendFile(int fd, qint64 offset, qint64 length) {
   QFCgiConnection *connection = qobject_cast<QFCgiConnection*>(parent());
-  QFCgiRecord record = QFCgiRecord::createOutStream(this->id, ba.left(nbytes));
+  struct stat st;
+
+  if (this->ended) {
+    q2Debug("sendFile - request already ended");
+    return false;
+  }
+
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    q2Debug("sendFile - not a regular file");
+    return false;
+  }
 
-  ba.remove(0, nbytes);
-  connection->send(record);
+  if (length < 0) {
+    length = st.st_size - offset;
+  }
+
+  if (offset < 0 || length < 0 || offset + length > st.st_size) {
+    q2Debug("sendFile - invalid range [offset: %lli, length: %lli]", offset, length);
+    return false;
+  }
+
+  // output written so far goes first
+  sendStream(this->out);
+
+  return connection->sendFile(this->id, fd, offset, length);
 }
 
-void QFCgiRequest::onErrBytesWritten(qint64 bytes __unused) {
-  QByteArray &ba = this->err->getBuffer();
-  int nbytes = qMin(65535, ba.size());
+bool QFCgiRequest::sendFile(const QString &fileName, qint64 offset, qint64 length) {
+  int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY);
 
-  QFCgiConnection *connection = qobject_cast<QFCgiConnection*>(parent());
-  QFCgiRecord record = QFCgiRecord::createErrStream(this->id, ba.left(nbytes));
+  if (fd == -1) {
+    q2Debug("sendFile - %s: %s", qPrintable(fileName), strerror(errno));
+    return false;
+  }
 
-  ba.remove(0, nbytes);
-  connection->send(record);
+  bool result = sendFile(fd, offset, length);
+  ::close(fd);
+
+  return result;
 }
 
-void QFCgiRequest::consumeParamsBuffer(const QByteArray &data) {
-  qint32 nread;
-  QString name, value;
+enum QFCgiRequest::OutputPolicy QFCgiRequest::getOutputPolicy() const {
+  return this->outputPolicy;
+}
 
-  this->paramsBuffer.append(data);
+void QFCgiRequest::setOutputPolicy(enum OutputPolicy policy, int flushSize) {
+  this->outputPolicy = policy;
+  this->flushSize = qMax(flushSize, 1);
+}
 
-  while ((nread = readNameValuePair(name, value)) > 0) {
-    q2Debug("param(%s): %s", qPrintable(name), qPrintable(value));
-    this->paramsBuffer.remove(0, nread);
-    this->params.insert(name, value);
-  }
+bool QFCgiRequest::isAborted() const {
+  return this->abortFlag;
 }
 
-qint32 QFCgiRequest::readNameValuePair(QString &name, QString &value) {
-  quint32 nameLength, valueLength;
-  qint32 nnl, nvl, nn, nv;
+void QFCgiRequest::flush() {
+  this->flushScheduled = false;
 
-  if ((nnl = readLengthField(0, &nameLength)) <= 0) {
-    return nnl;
-  }
+  sendStream(this->out);
+  sendStream(this->err);
+}
 
-  if ((nvl = readLengthField(nnl, &valueLength)) <= 0) {
-    return nvl;
-  }
+void QFCgiRequest::onOutBytesWritten(qint64 bytes __unused) {
+  onStreamWritten(this->out);
+}
 
-  if ((nn = readValueField(nnl + nvl, nameLength, name)) <= 0) {
-    return nn;
-  }
+void QFCgiRequest::onErrBytesWritten(qint64 bytes __unused) {
+  onStreamWritten(this->err);
+}
 
-  if ((nv = readValueField(nnl + nvl + nn, valueLength, value)) <= 0) {
-    return nv;
+void QFCgiRequest::onStreamWritten(QFCgiStream *stream) {
+  switch (this->outputPolicy) {
+    case Unbuffered:
+      sendStream(stream);
+      break;
+    case FlushAtSize:
+      if (stream->getBuffer().size() >= this->flushSize) {
+        sendStream(stream);
+      }
+      break;
+    case FlushOnIdle:
+      if (!this->flushScheduled) {
+        this->flushScheduled = true;
+        QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+      }
+      break;
+    case FlushOnEnd:
+      break;
   }
-
-  return nnl + nvl + nn + nv;
 }
 
-qint32 QFCgiRequest::readLengthField(int pos, quint32 *length) {
-  QByteArray ba = this->paramsBuffer.mid(pos);
+void QFCgiRequest::sendStream(QFCgiStream *stream) {
+  QFCgiConnection *connection = qobject_cast<QFCgiConnection*>(parent());
+  QByteArray &ba = stream->getBuffer();
+  QFCgiRecord::Type type = (stream == this->out) ? QFCgiRecord::FCGI_STDOUT : QFCgiRecord::FCGI_STDERR;
 
   if (ba.isEmpty()) {
-    return 0;
+    return;
   }
 
-  if ((ba[0] & 0x80) == 0) {
-    *length = ba[0] & 0xFF;
-    return 1;
+  if (this->ended) {
+    // output written after the end of the request is discarded
+    ba.clear();
+    return;
   }
 
-  if (ba.size() < 4) {
-    return 0;
+  if (ba.size() <= MAX_ALIGNED_CONTENT_LENGTH) {
+    // hand over the whole buffer, no copy
+    QFCgiRecord record = createStreamRecord(type, this->id, ba);
+    ba = QByteArray();
+    connection->send(record);
+    return;
   }
 
-  *length = ((ba[0] & 0x7F) << 24) |
-            ((ba[1] & 0xFF) << 16) |
-            ((ba[2] & 0xFF) << 8) |
-            (ba[3] & 0xFF);
+  for (int pos = 0; pos < ba.size(); pos += MAX_ALIGNED_CONTENT_LENGTH) {
+    QByteArray data = ba.mid(pos, MAX_ALIGNED_CONTENT_LENGTH);
+    connection->send(createStreamRecord(type, this->id, data));
+  }
 
-  return 4;
+  ba.clear();
 }
 
-qint32 QFCgiRequest::readValueField(int pos, quint32 length, QString &value) {
-  QByteArray ba = this->paramsBuffer.mid(pos);
+void QFCgiRequest::reset(int id, bool keepConn) {
+  // connections made for a previous request are dropped
+  disconnect();
+  this->in->disconnect();
+  this->out->disconnect();
+  this->err->disconnect();
 
-  if (ba.size() >= (int)length) {
-    value = ba.left(length);
-    return length;
-  } else {
-    return 0;
+  this->id = id;
+  this->keepConn = keepConn;
+  this->ended = false;
+  this->abortFlag = false;
+  this->abortEnded = false;
+  this->outputPolicy = FlushOnIdle;
+  this->flushSize = MAX_ALIGNED_CONTENT_LENGTH;
+  this->flushScheduled = false;
+  this->beginTime = 0;
+  this->paramsTime = 0;
+  this->params->clear();
+
+  // unbuffered, the device does not read ahead of the application (see
+  // getInFileDescriptor())
+  this->in->reopen(QIODevice::ReadOnly | QIODevice::Unbuffered);
+  this->out->reopen(QIODevice::WriteOnly);
+  this->err->reopen(QIODevice::WriteOnly);
+
+  connect(this->out, SIGNAL(bytesWritten(qint64)), this, SLOT(onOutBytesWritten(qint64)));
+  connect(this->err, SIGNAL(bytesWritten(qint64)), this, SLOT(onErrBytesWritten(qint64)));
+}
+
+bool QFCgiRequest::consumeParamsBuffer(const QByteArray &data) {
+  return this->params->consume(data.constData(), data.size());
+}
+
+void QFCgiRequest::abort() {
+  this->abortFlag = true;
+  emit aborted();
+
+  // The handler might have ended the request by itself. Otherwise the
+  // application still holds the request, it is not reused before the
+  // application ends it as well.
+  if (!this->ended) {
+    this->abortEnded = true;
+    endRequest(0);
   }
 }
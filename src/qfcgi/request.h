@@ -18,11 +18,14 @@
 #ifndef QFCGI_REQUEST_H
 #define QFCGI_REQUEST_H
 
-#include <QHash>
+#include <QByteArray>
+#include <QList>
 #include <QObject>
 #include <QMetaType>
+#include <QString>
 
 class QFCgiConnection;
+class QFCgiParams;
 class QFCgiStream;
 
 /**
@@ -41,6 +44,10 @@ class QFCgiStream;
  * input-data. The #getOut() resp. #getErr() devices can be used to send
  * output-data back to the web-server.
  *
+ * Output-data are buffered according to the #setOutputPolicy() of the request
+ * and packed into as few records as possible. Call #flush() to send buffered
+ * output-data immediately.
+ *
  * The final operation should be always an invocation of #endRequest() which
  * terminates the requests and asks to destroy the request-instance.
  */
@@ -48,6 +55,83 @@ class QFCgiRequest : public QObject {
   Q_OBJECT
 
 public:
+  /**
+   * Well-known CGI parameters.
+   *
+   * Web servers send (most of) these parameters with every request. They are
+   * recognized while the parameters are received and can be fetched with
+   * #getParam(enum Param) without a lookup by name.
+   *
+   * @note The parameters are ordered by name, keep it that way when adding
+   *       new ones.
+   */
+  enum Param {
+    AUTH_TYPE,
+    CONTENT_LENGTH,
+    CONTENT_TYPE,
+    DOCUMENT_ROOT,
+    DOCUMENT_URI,
+    GATEWAY_INTERFACE,
+    HTTPS,
+    HTTP_ACCEPT,
+    HTTP_ACCEPT_ENCODING,
+    HTTP_ACCEPT_LANGUAGE,
+    HTTP_AUTHORIZATION,
+    HTTP_CONNECTION,
+    HTTP_COOKIE,
+    HTTP_HOST,
+    HTTP_REFERER,
+    HTTP_USER_AGENT,
+    HTTP_X_FORWARDED_FOR,
+    PATH_INFO,
+    PATH_TRANSLATED,
+    QUERY_STRING,
+    REDIRECT_STATUS,
+    REMOTE_ADDR,
+    REMOTE_HOST,
+    REMOTE_PORT,
+    REMOTE_USER,
+    REQUEST_METHOD,
+    REQUEST_SCHEME,
+    REQUEST_URI,
+    SCRIPT_FILENAME,
+    SCRIPT_NAME,
+    SERVER_ADDR,
+    SERVER_NAME,
+    SERVER_PORT,
+    SERVER_PROTOCOL,
+    SERVER_SOFTWARE
+  };
+
+  /**
+   * Policy used to send data written to #getOut() resp. #getErr() back to the
+   * web-server.
+   */
+  enum OutputPolicy {
+    /**
+     * Every write-operation is sent immediately.
+     */
+    Unbuffered,
+
+    /**
+     * Output-data are sent, once the amount of buffered data reaches the
+     * flush-size.
+     */
+    FlushAtSize,
+
+    /**
+     * Output-data are sent, when control returns to the Qt event loop. This
+     * is the default policy.
+     */
+    FlushOnIdle,
+
+    /**
+     * Output-data are sent, when the request is
+     * @link #endRequest() terminated @endlink or #flush() is invoked.
+     */
+    FlushOnEnd
+  };
+
   /**
    * Returns the id of the request.
    *
@@ -78,17 +162,18 @@ public:
    * This method-invocation is always the last action of the request. All
    * streams are closed, and the web-server receives a message, that signals
    * the end of the request. The <code>appStatus</code> is passed back to the
-   * web-server, where a value of <code>0</code> usually means success. The
-   * current request-object is marked for destruction, which means, that the
-   * object will be destroyed when control returns to the Qt event loop.
+   * web-server, where a value of <code>0</code> usually means success.
+   *
+   * When control returns to the Qt event loop, the request-object is reused
+   * for a later request of the same connection (or destroyed). Don't touch
+   * the object after the invocation. Signal-slot connections made by the
+   * application are dropped, before the object is reused.
    *
    * When the method is never invoked, then the request will stay open on the
    * web-server and might result into an error (depending on the web-server).
    *
    * @param appStatus Execution status of the request-operation, where
    *                  <code>0</code> usually means success.
-   *
-   * @see QObject::deleteLater()
    */
   void endRequest(quint32 appStatus);
 
@@ -111,6 +196,47 @@ public:
    */
   QString getParam(const QString &name) const;
 
+  /**
+   * Returns the raw value of a parameter received from the web-server.
+   *
+   * In contrast to #getParam() the value is not converted into a
+   * <code>QString</code>. The returned byte-array refers to the parameter
+   * storage of the request, no data are copied. It is valid until
+   * #endRequest(), because the storage is reused by a later request of the
+   * connection. Copy it if you need the value afterwards.
+   *
+   * @param name The name of the parameter
+   * @return The value of the requested parameter. If the parameter does not
+   *         exist, an empty byte-array is returned.
+   * @see getParam()
+   */
+  QByteArray getParamRaw(const QByteArray &name) const;
+
+  /**
+   * Returns the value of a well-known parameter received from the web-server.
+   *
+   * This is the same as <code>getParam(const QString &name)</code>, but
+   * without a lookup by name.
+   *
+   * @param param The well-known parameter
+   * @return The value of the requested parameter. If the parameter does not
+   *         exist, an empty string is returned.
+   */
+  QString getParam(enum Param param) const;
+
+  /**
+   * Returns the raw value of a well-known parameter received from the
+   * web-server.
+   *
+   * This is the same as <code>getParamRaw(const QByteArray &name)</code>, but
+   * without a lookup by name.
+   *
+   * @param param The well-known parameter
+   * @return The value of the requested parameter. If the parameter does not
+   *         exist, an empty byte-array is returned.
+   */
+  QByteArray getParamRaw(enum Param param) const;
+
   /**
    * Returns a stream to receive input-data from the web-server.
    *
@@ -122,6 +248,23 @@ public:
    */
   QIODevice* getIn() const;
 
+  /**
+   * Returns the file holding the input-data, if the request body was moved
+   * into a temporary file.
+   *
+   * See QFCgi::setInputSpillThreshold(). The file is already unlinked and
+   * closed together with the request. Input-data read from #getIn() before
+   * the body was moved are not part of the file, it starts at offset
+   * <code>0</code> with the first byte not yet read. #getIn() is unbuffered,
+   * it never reads ahead of the application. Once #getIn() reached the end
+   * of the stream, the file holds the rest of the request body. Reading the
+   * file does not advance #getIn().
+   *
+   * @return The file-descriptor of the request body or <code>-1</code>, if
+   *         the body is buffered in memory.
+   */
+  int getInFileDescriptor() const;
+
   /**
    * Returns a stream used to send back output-data to the web-server.
    *
@@ -146,6 +289,96 @@ public:
    */
   QIODevice* getErr() const;
 
+  /**
+   * Sends a range of a file as output-data back to the web-server.
+   *
+   * The file is sent after the output-data already written to #getOut().
+   * Instead of reading the file into memory, the library passes the range of
+   * the file to the kernel (<code>sendfile()</code>), which copies it
+   * straight into the connection to the web-server. Where this is not
+   * possible, the file is read in pieces of a record.
+   *
+   * The file must be a regular file and must not be truncated until the
+   * request is @link #endRequest() terminated @endlink. The descriptor is
+   * duplicated, thus the caller is free to close <code>fd</code> when the
+   * method returns.
+   *
+   * @param fd The file-descriptor of the file
+   * @param offset Position of the first byte to send
+   * @param length Number of bytes to send, <code>-1</code> sends everything up
+   *               to the end of the file.
+   * @return <code>true</code> if the range of the file is queued for sending,
+   *         <code>false</code> otherwise.
+   */
+  bool sendFile(int fd, qint64 offset = 0, qint64 length = -1);
+
+  /**
+   * Sends a range of a file as output-data back to the web-server.
+   *
+   * This is the same as <code>sendFile(int fd, qint64 offset, qint64
+   * length)</code>, but opens the file by its name.
+   *
+   * @param fileName The name of the file
+   * @param offset Position of the first byte to send
+   * @param length Number of bytes to send, <code>-1</code> sends everything up
+   *               to the end of the file.
+   * @return <code>true</code> if the range of the file is queued for sending,
+   *         <code>false</code> otherwise.
+   */
+  bool sendFile(const QString &fileName, qint64 offset = 0, qint64 length = -1);
+
+  /**
+   * Returns the policy used to send back output-data to the web-server.
+   *
+   * @return The output-policy of the request
+   * @see setOutputPolicy()
+   */
+  enum OutputPolicy getOutputPolicy() const;
+
+  /**
+   * Changes the policy used to send back output-data to the web-server.
+   *
+   * Buffered output-data are packed into records of the maximum size allowed
+   * by the FastCGI-specification, which saves a record-header (and padding)
+   * for every write-operation of the application.
+   *
+   * @param policy The new output-policy
+   * @param flushSize Number of buffered bytes, which are sent at once. Only
+   *                  used by the #FlushAtSize policy.
+   */
+  void setOutputPolicy(enum OutputPolicy policy, int flushSize = 65528);
+
+  /**
+   * Tests whether the web-server aborted the request.
+   *
+   * The web-server aborts a request, when its client goes away. Long-running
+   * handlers can poll the flag to stop computing a response, which nobody
+   * will read.
+   *
+   * @return <code>true</code> if the request was aborted.
+   * @see aborted()
+   */
+  bool isAborted() const;
+
+signals:
+  /**
+   * This signal is emitted when the web-server aborted the request.
+   *
+   * The library already terminated the request, thus output-data written
+   * afterwards are discarded. Still invoke #endRequest(), the request-object
+   * is not reused (and its connection is not closed) before.
+   */
+  void aborted();
+
+public slots:
+  /**
+   * Sends all buffered output-data back to the web-server.
+   *
+   * Use the method for streaming responses, where the web-server should
+   * receive the data, before the request is terminated.
+   */
+  void flush();
+
 private slots:
   void onOutBytesWritten(qint64 bytes);
   void onErrBytesWritten(qint64 bytes);
@@ -154,20 +387,28 @@ private:
   friend class QFCgiConnection;
 
   QFCgiRequest(int id, bool keepConn, QFCgiConnection *parent);
-  virtual ~QFCgiRequest() {}
+  virtual ~QFCgiRequest();
 
-  void consumeParamsBuffer(const QByteArray &data);
-  qint32 readNameValuePair(QString &name, QString &value);
-  qint32 readLengthField(int pos, quint32 *length);
-  qint32 readValueField(int pos, quint32 length, QString &value);
+  void reset(int id, bool keepConn);
+  bool consumeParamsBuffer(const QByteArray &data);
+  void abort();
+  void onStreamWritten(QFCgiStream *stream);
+  void sendStream(QFCgiStream *stream);
 
   int id;
   bool keepConn;
-  QByteArray paramsBuffer;
+  bool ended;
+  bool abortFlag;
+  bool abortEnded;
+  qint64 beginTime;
+  qint64 paramsTime;
   QFCgiStream *in;
   QFCgiStream *out;
   QFCgiStream *err;
-  QHash<QString, QString> params;
+  QFCgiParams *params;
+  enum OutputPolicy outputPolicy;
+  int flushSize;
+  bool flushScheduled;
 };
 
 Q_DECLARE_METATYPE(QFCgiRequest*);
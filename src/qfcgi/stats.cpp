@@ -0,0 +1,185 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+QFCgiStats::QFCgiStats() {
+  this->acceptedConnections = 0;
+  this->closedConnections = 0;
+  this->startedRequests = 0;
+  this->completedRequests = 0;
+  this->rejectedRequests = 0;
+  this->abortedRequests = 0;
+  this->bytesIn = 0;
+  this->bytesOut = 0;
+  this->parseErrors = 0;
+
+  memset(this->records, 0, sizeof(this->records));
+  memset(this->latencies, 0, sizeof(this->latencies));
+  memset(this->latencySums, 0, sizeof(this->latencySums));
+}
+
+quint64 QFCgiStats::getAcceptedConnections() const {
+  return this->acceptedConnections;
+}
+
+quint64 QFCgiStats::getClosedConnections() const {
+  return this->closedConnections;
+}
+
+quint64 QFCgiStats::getStartedRequests() const {
+  return this->startedRequests;
+}
+
+quint64 QFCgiStats::getCompletedRequests() const {
+  return this->completedRequests;
+}
+
+quint64 QFCgiStats::getActiveRequests() const {
+  // the counters of a thread might be read in between
+  return (this->startedRequests > this->completedRequests) ? this->startedRequests - this->completedRequests : 0;
+}
+
+quint64 QFCgiStats::getRejectedRequests() const {
+  return this->rejectedRequests;
+}
+
+quint64 QFCgiStats::getAbortedRequests() const {
+  return this->abortedRequests;
+}
+
+quint64 QFCgiStats::getBytesIn() const {
+  return this->bytesIn;
+}
+
+quint64 QFCgiStats::getBytesOut() const {
+  return this->bytesOut;
+}
+
+quint64 QFCgiStats::getRecordCount(int type) const {
+  return (type >= 0 && type < NUM_RECORD_TYPES) ? this->records[type] : 0;
+}
+
+quint64 QFCgiStats::getParseErrors() const {
+  return this->parseErrors;
+}
+
+quint64 QFCgiStats::getLatencyCount(enum Latency latency) const {
+  quint64 count = 0;
+
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    count += this->latencies[latency][i];
+  }
+
+  return count;
+}
+
+quint64 QFCgiStats::getLatencySum(enum Latency latency) const {
+  return this->latencySums[latency];
+}
+
+quint64 QFCgiStats::getLatencyBucket(enum Latency latency, int bucket) const {
+  return (bucket >= 0 && bucket < NUM_BUCKETS) ? this->latencies[latency][bucket] : 0;
+}
+
+qint64 QFCgiStats::getBucketUpperBound(int bucket) {
+  if (bucket < 4) {
+    return bucket;
+  }
+
+  // four buckets per power of two, see bucketOf()
+  int shift = bucket / 4 - 1;
+  qint64 lower = (qint64)(4 + bucket % 4) << shift;
+
+  return lower + ((qint64)1 << shift) - 1;
+}
+
+qint64 QFCgiStats::getLatencyPercentile(enum Latency latency, double percentile) const {
+  quint64 count = getLatencyCount(latency);
+  quint64 rank = (quint64)(count * qBound(0.0, percentile, 100.0) / 100.0 + 0.5);
+  quint64 seen = 0;
+
+  if (count == 0) {
+    return 0;
+  }
+
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    seen += this->latencies[latency][i];
+
+    if (seen >= qMax(rank, (quint64)1)) {
+      return getBucketUpperBound(i);
+    }
+  }
+
+  return getBucketUpperBound(NUM_BUCKETS - 1);
+}
+
+void QFCgiStats::merge(const QFCgiStats &stats) {
+  this->acceptedConnections += stats.acceptedConnections;
+  this->closedConnections += stats.closedConnections;
+  this->startedRequests += stats.startedRequests;
+  this->completedRequests += stats.completedRequests;
+  this->rejectedRequests += stats.rejectedRequests;
+  this->abortedRequests += stats.abortedRequests;
+  this->bytesIn += stats.bytesIn;
+  this->bytesOut += stats.bytesOut;
+  this->parseErrors += stats.parseErrors;
+
+  for (int i = 0; i < NUM_RECORD_TYPES; i++) {
+    this->records[i] += stats.records[i];
+  }
+
+  for (int i = 0; i <= TotalLatency; i++) {
+    this->latencySums[i] += stats.latencySums[i];
+
+    for (int j = 0; j < NUM_BUCKETS; j++) {
+      this->latencies[i][j] += stats.latencies[i][j];
+    }
+  }
+}
+
+void QFCgiStats::addLatency(enum Latency latency, qint64 usecs) {
+  this->latencies[latency][bucketOf(usecs)]++;
+  this->latencySums[latency] += qMax(usecs, (qint64)0);
+}
+
+int QFCgiStats::bucketOf(qint64 usecs) {
+  if (usecs < 4) {
+    return (int)qMax(usecs, (qint64)0);
+  }
+
+  // The two bits below the highest bit select one of four buckets of the
+  // power of two.
+  int exponent = 2;
+
+  while ((usecs >> (exponent + 1)) != 0) {
+    exponent++;
+  }
+
+  int sub = (usecs >> (exponent - 2)) & 3;
+  return qMin(4 * (exponent - 1) + sub, NUM_BUCKETS - 1);
+}
+
+qint64 QFCgiStats::now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (qint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,239 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QFCGI_STATS_H
+#define QFCGI_STATS_H
+
+#include <QMetaType>
+#include <QtGlobal>
+
+/**
+ * Counters and latency histograms of a FastCGI application server.
+ *
+ * A snapshot of the statistics is obtained with QFCgi::getStats() or
+ * periodically with the QFCgi::statsUpdated() signal. All values count from
+ * the #QFCgi::start() of the application server.
+ *
+ * The counters are maintained by the thread serving a connection, without
+ * any locking. A snapshot is taken on every thread and summed up, thus the
+ * values of the threads are taken at slightly different times.
+ *
+ * Latencies are measured in microseconds and collected in histograms with
+ * logarithmic buckets. Every power of two is divided into four buckets, a
+ * value is reported with a relative error of at most 25%.
+ */
+class QFCgiStats {
+public:
+  /**
+   * The latencies measured for every request.
+   */
+  enum Latency {
+    /**
+     * From the <code>FCGI_BEGIN_REQUEST</code> record until all parameters
+     * are received and the request is signaled with QFCgi::newRequest().
+     */
+    ParamsLatency,
+
+    /**
+     * From QFCgi::newRequest() until the application calls
+     * QFCgiRequest::endRequest().
+     */
+    ResponseLatency,
+
+    /**
+     * From the <code>FCGI_BEGIN_REQUEST</code> record until the application
+     * calls QFCgiRequest::endRequest().
+     */
+    TotalLatency
+  };
+
+  /**
+   * The number of buckets of a latency histogram.
+   */
+  static const int NUM_BUCKETS = 128;
+
+  /**
+   * The number of record types counted by #getRecordCount().
+   */
+  static const int NUM_RECORD_TYPES = 12;
+
+  /**
+   * Creates a new instance of the class, all values are <code>0</code>.
+   */
+  QFCgiStats();
+
+  /**
+   * Returns the number of connections accepted from the web server.
+   *
+   * @return The number of accepted connections
+   */
+  quint64 getAcceptedConnections() const;
+
+  /**
+   * Returns the number of connections closed.
+   *
+   * @return The number of closed connections
+   */
+  quint64 getClosedConnections() const;
+
+  /**
+   * Returns the number of requests received from the web server and passed
+   * to the application.
+   *
+   * @return The number of started requests
+   */
+  quint64 getStartedRequests() const;
+
+  /**
+   * Returns the number of requests ended with QFCgiRequest::endRequest().
+   *
+   * @return The number of completed requests
+   */
+  quint64 getCompletedRequests() const;
+
+  /**
+   * Returns the number of requests in flight, that are started but not yet
+   * completed.
+   *
+   * @return The number of active requests
+   */
+  quint64 getActiveRequests() const;
+
+  /**
+   * Returns the number of requests rejected by the application server,
+   * either because of a limit (<code>FCGI_OVERLOADED</code>) or an
+   * unsupported role.
+   *
+   * @return The number of rejected requests
+   */
+  quint64 getRejectedRequests() const;
+
+  /**
+   * Returns the number of requests aborted by the web server.
+   *
+   * @return The number of aborted requests
+   */
+  quint64 getAbortedRequests() const;
+
+  /**
+   * Returns the number of bytes read from the web server.
+   *
+   * @return The number of bytes read
+   */
+  quint64 getBytesIn() const;
+
+  /**
+   * Returns the number of bytes written to the web server.
+   *
+   * @return The number of bytes written
+   */
+  quint64 getBytesOut() const;
+
+  /**
+   * Returns the number of records of the given type read from the web
+   * server.
+   *
+   * @param type The record type, e.g. <code>5</code> for
+   *             <code>FCGI_STDIN</code>
+   * @return The number of records read, <code>0</code> for an unknown type
+   */
+  quint64 getRecordCount(int type) const;
+
+  /**
+   * Returns the number of connections closed, because the web server sent
+   * data, which are not a valid record.
+   *
+   * @return The number of parse errors
+   */
+  quint64 getParseErrors() const;
+
+  /**
+   * Returns the number of latencies collected in a histogram.
+   *
+   * @param latency The histogram
+   * @return The number of values
+   */
+  quint64 getLatencyCount(enum Latency latency) const;
+
+  /**
+   * Returns the sum of the latencies (in microseconds) collected in a
+   * histogram.
+   *
+   * @param latency The histogram
+   * @return The sum of the values
+   */
+  quint64 getLatencySum(enum Latency latency) const;
+
+  /**
+   * Returns the number of latencies collected in a bucket of a histogram.
+   *
+   * @param latency The histogram
+   * @param bucket Index of the bucket, between <code>0</code> and
+   *               #NUM_BUCKETS - 1
+   * @return The number of values in the bucket
+   * @see getBucketUpperBound()
+   */
+  quint64 getLatencyBucket(enum Latency latency, int bucket) const;
+
+  /**
+   * Returns the largest latency (in microseconds) collected in the given
+   * bucket.
+   *
+   * @param bucket Index of the bucket, between <code>0</code> and
+   *               #NUM_BUCKETS - 1
+   * @return The upper bound of the bucket
+   */
+  static qint64 getBucketUpperBound(int bucket);
+
+  /**
+   * Returns the latency (in microseconds), below which the given percentage
+   * of the values of a histogram is.
+   *
+   * @param latency The histogram
+   * @param percentile The percentage, e.g. <code>99.0</code>
+   * @return The upper bound of the bucket containing the percentile,
+   *         <code>0</code> if the histogram is empty.
+   */
+  qint64 getLatencyPercentile(enum Latency latency, double percentile) const;
+
+private:
+  friend class QFCgi;
+  friend class QFCgiConnection;
+
+  void merge(const QFCgiStats &stats);
+  void addLatency(enum Latency latency, qint64 usecs);
+
+  static int bucketOf(qint64 usecs);
+  static qint64 now();
+
+  quint64 acceptedConnections;
+  quint64 closedConnections;
+  quint64 startedRequests;
+  quint64 completedRequests;
+  quint64 rejectedRequests;
+  quint64 abortedRequests;
+  quint64 bytesIn;
+  quint64 bytesOut;
+  quint64 records[NUM_RECORD_TYPES];
+  quint64 parseErrors;
+  quint64 latencies[TotalLatency + 1][NUM_BUCKETS];
+  quint64 latencySums[TotalLatency + 1];
+};
+
+Q_DECLARE_METATYPE(QFCgiStats);
+
+#endif  /* QFCGI_STATS_H */
@@ -15,24 +15,84 @@
  * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <QDir>
+
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
 #include "stream.h"
 
 #define is_readable() ((openMode() & QIODevice::ReadOnly) > 0)
 #define is_writable() ((openMode() & QIODevice::WriteOnly) > 0)
 
-QFCgiStream::QFCgiStream(QObject *parent) : QIODevice(parent) {
+/*
+ * Size of the first block of the input arena, which is kept for the next
+ * request. Small request bodies fit into it.
+ */
+#define ARENA_SIZE 4096
+
+/*
+ * Maximum block size of the input arena, a block holds the content of a whole
+ * record.
+ */
+#define MAX_ARENA_SIZE 65536
+
+/*
+ * Number of chunks reserved up front. Read chunks are removed from the queue,
+ * once there are as many of them.
+ */
+#define CHUNKS_SIZE 16
+
+QFCgiStream::QFCgiStream(QObject *parent) : QIODevice(parent), arena(ARENA_SIZE, MAX_ARENA_SIZE) {
+  // a reserved vector keeps its capacity, when it is cleared
+  this->chunks.reserve(CHUNKS_SIZE);
+  this->chunkIndex = 0;
+  this->chunkOffset = 0;
+  this->pending = 0;
   this->eof = false;
+  this->received = 0;
+  this->spillThreshold = 0;
+  this->fd = -1;
+  this->readOffset = 0;
+  this->writeOffset = 0;
+  this->map = 0;
 }
 
 QFCgiStream::~QFCgiStream() {
+  releaseFile();
+}
+
+void QFCgiStream::close() {
+  QIODevice::close();
+
+  // unread data are dropped
+  clearChunks();
+  this->pending = 0;
+  this->received = 0;
+  releaseFile();
+}
+
+void QFCgiStream::reopen(OpenMode mode) {
+  close();
+
+  // the stream starts over for another request
+  this->eof = false;
+  this->buffer.clear();
+  this->spillThreshold = 0;
+
+  open(mode);
 }
 
 bool QFCgiStream::atEnd() const {
-  return is_readable() && this->eof && this->buffer.isEmpty();
+  return is_readable() && this->eof && this->pending == 0;
 }
 
 qint64 QFCgiStream::bytesAvailable() const {
-  return this->buffer.size() + QIODevice::bytesAvailable();
+  return this->pending + QIODevice::bytesAvailable();
 }
 
 bool QFCgiStream::isSequential() const {
@@ -45,7 +105,28 @@ QByteArray& QFCgiStream::getBuffer() {
 
 bool QFCgiStream::append(const QByteArray &ba) {
   if (is_readable() && !this->eof) {
-    this->buffer.append(ba);
+    this->received += ba.size();
+
+    if (this->fd == -1 && this->spillThreshold > 0 && this->received > this->spillThreshold) {
+      spill();
+    }
+
+    if (this->fd != -1) {
+      if (!writeFile(ba.constData(), ba.size())) {
+        return false;
+      }
+    } else if (!ba.isEmpty()) {
+      // ba might be a raw view
+      Chunk chunk;
+      char *data = this->arena.allocate(ba.size());
+
+      memcpy(data, ba.constData(), ba.size());
+      chunk.data = data;
+      chunk.size = ba.size();
+      this->chunks.append(chunk);
+    }
+
+    this->pending += ba.size();
     emit readyRead();
     return true;
   } else {
@@ -56,6 +137,17 @@ bool QFCgiStream::append(const QByteArray &ba) {
 bool QFCgiStream::setEof() {
   if (is_readable() && !this->eof) {
     this->eof = true;
+
+    if (this->fd != -1 && this->writeOffset > 0) {
+      void *addr = mmap(0, this->writeOffset, PROT_READ, MAP_PRIVATE, this->fd, 0);
+
+      if (addr != MAP_FAILED) {
+        this->map = (uchar*)addr;
+      } else {
+        qDebug("mmap: %s", strerror(errno));
+      }
+    }
+
     emit readChannelFinished();
     return true;
   } else {
@@ -63,14 +155,65 @@ bool QFCgiStream::setEof() {
   }
 }
 
+bool QFCgiStream::isEof() const {
+  return this->eof;
+}
+
+qint64 QFCgiStream::bytesInMemory() const {
+  return ((this->fd == -1) ? this->pending : 0) + QIODevice::bytesAvailable();
+}
+
+void QFCgiStream::setSpillThreshold(qint64 threshold) {
+  this->spillThreshold = threshold;
+}
+
+int QFCgiStream::fileDescriptor() const {
+  return this->fd;
+}
+
 qint64 QFCgiStream::readData(char *data, qint64 maxSize) {
   if (is_readable()) {
-    if (this->buffer.isEmpty()) {
+    if (this->pending == 0) {
       return this->eof ? -1 : 0;
     }
-    qint64 nbytes = qMin(this->buffer.size(), (int)maxSize);
-    memcpy(data, this->buffer.data(), nbytes);
-    this->buffer.remove(0, nbytes);
+
+    if (this->fd != -1) {
+      qint64 nbytes = readFile(data, maxSize);
+
+      if (nbytes > 0) {
+        this->pending -= nbytes;
+        emit bytesRead(nbytes);
+      }
+
+      return nbytes;
+    }
+
+    qint64 nbytes = 0;
+
+    while (nbytes < maxSize && this->chunkIndex < this->chunks.size()) {
+      const Chunk &chunk = this->chunks.at(this->chunkIndex);
+      qint64 n = qMin((qint64)(chunk.size - this->chunkOffset), maxSize - nbytes);
+
+      memcpy(data + nbytes, chunk.data + this->chunkOffset, n);
+      nbytes += n;
+      this->chunkOffset += n;
+
+      if (this->chunkOffset == chunk.size) {
+        this->chunkIndex++;
+        this->chunkOffset = 0;
+      }
+    }
+
+    this->pending -= nbytes;
+
+    if (this->pending == 0) {
+      // everything read, the memory is reused for the next chunks
+      clearChunks();
+    } else if (this->chunkIndex > 0) {
+      releaseChunks();
+    }
+
+    emit bytesRead(nbytes);
 
     return nbytes;
   } else {
@@ -78,6 +221,117 @@ qint64 QFCgiStream::readData(char *data, qint64 maxSize) {
   }
 }
 
+bool QFCgiStream::spill() {
+  QByteArray path = QDir::tempPath().toLocal8Bit().append("/qfcgi-XXXXXX");
+#ifdef O_CLOEXEC
+  int fd = mkostemp(path.data(), O_CLOEXEC);
+#else
+  int fd = mkstemp(path.data());
+
+  if (fd != -1) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+#endif
+
+  if (fd == -1) {
+    qDebug("mkstemp: %s", strerror(errno));
+    this->spillThreshold = 0; // keep the input in memory
+    return false;
+  }
+
+  // nobody else needs the file, it disappears with the last descriptor
+  unlink(path.constData());
+  this->fd = fd;
+
+  // move the unread chunks into the file
+  for (int i = this->chunkIndex; i < this->chunks.size(); i++) {
+    const Chunk &chunk = this->chunks.at(i);
+    int offset = (i == this->chunkIndex) ? this->chunkOffset : 0;
+
+    if (!writeFile(chunk.data + offset, chunk.size - offset)) {
+      // the chunks are still complete, keep the input in memory
+      releaseFile();
+      this->spillThreshold = 0;
+      return false;
+    }
+  }
+
+  clearChunks();
+  return true;
+}
+
+void QFCgiStream::releaseChunks() {
+  // the blocks of the read chunks are freed, while the stream is still read
+  this->arena.release(this->chunks.at(this->chunkIndex).data);
+
+  if (this->chunkIndex >= CHUNKS_SIZE) {
+    this->chunks.remove(0, this->chunkIndex);
+    this->chunkIndex = 0;
+  }
+}
+
+void QFCgiStream::clearChunks() {
+  this->chunks.resize(0);
+  this->chunkIndex = 0;
+  this->chunkOffset = 0;
+  this->arena.reset();
+}
+
+bool QFCgiStream::writeFile(const char *data, qint64 size) {
+  while (size > 0) {
+    ssize_t nwritten = pwrite(this->fd, data, size, this->writeOffset);
+
+    if (nwritten < 0 && errno == EINTR) {
+      continue;
+    } else if (nwritten < 0) {
+      qDebug("pwrite: %s", strerror(errno));
+      setErrorString(QString::fromLocal8Bit(strerror(errno)));
+      return false;
+    }
+
+    data += nwritten;
+    size -= nwritten;
+    this->writeOffset += nwritten;
+  }
+
+  return true;
+}
+
+qint64 QFCgiStream::readFile(char *data, qint64 maxSize) {
+  qint64 n = qMin(maxSize, this->writeOffset - this->readOffset);
+
+  if (this->map != 0) {
+    memcpy(data, this->map + this->readOffset, n);
+  } else {
+    do {
+      n = pread(this->fd, data, n, this->readOffset);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+      setErrorString(QString::fromLocal8Bit(strerror(errno)));
+      return -1;
+    }
+  }
+
+  this->readOffset += n;
+  return n;
+}
+
+void QFCgiStream::releaseFile() {
+  if (this->map != 0) {
+    munmap(this->map, this->writeOffset);
+    this->map = 0;
+  }
+
+  if (this->fd != -1) {
+    ::close(this->fd);
+    this->fd = -1;
+  }
+
+  this->readOffset = 0;
+  this->writeOffset = 0;
+}
+
 qint64 QFCgiStream::writeData(const char *data, qint64 maxSize) {
   if (is_writable()) {
     this->buffer.append(data, maxSize);
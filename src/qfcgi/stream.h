@@ -19,7 +19,23 @@
 #define QFCGI_STREAM_H
 
 #include <QIODevice>
+#include <QVector>
 
+#include "arena.h"
+
+/*
+ * Stream between the application and the web server.
+ *
+ * Data received from the web server are #append()ed as chunks to a queue,
+ * reading advances a cursor through the queue. The chunks are copied into an
+ * arena, whose blocks are freed as soon as they are read. The arena is rewound
+ * whenever everything is read. Data written by the application are collected
+ * in #getBuffer().
+ *
+ * Once more input than the spill-threshold is received, the input is moved
+ * into an unlinked temporary file. At the end of the stream the file is
+ * mapped into memory and read from the mapping.
+ */
 class QFCgiStream : public QIODevice {
   Q_OBJECT
 
@@ -27,6 +43,8 @@ public:
   QFCgiStream(QObject *parent = 0);
   virtual ~QFCgiStream();
 
+  void close();
+  void reopen(OpenMode mode);
   bool atEnd() const;
   qint64 bytesAvailable() const;
   bool isSequential() const;
@@ -34,14 +52,46 @@ public:
   QByteArray& getBuffer();
   bool append(const QByteArray &ba);
   bool setEof();
+  bool isEof() const;
+
+  qint64 bytesInMemory() const;
+  void setSpillThreshold(qint64 threshold);
+  int fileDescriptor() const;
+
+signals:
+  void bytesRead(qint64 bytes);
 
 protected:
   qint64 readData(char *data, qint64 maxSize);
   qint64 writeData(const char *data, qint64 maxSize);
 
 private:
+  bool spill();
+  bool writeFile(const char *data, qint64 size);
+  qint64 readFile(char *data, qint64 maxSize);
+  void releaseFile();
+
+  struct Chunk {
+    const char *data;
+    int size;
+  };
+
+  void releaseChunks();
+  void clearChunks();
+
+  QFCgiArena arena;
+  QVector<Chunk> chunks;
+  int chunkIndex;
+  int chunkOffset;
+  qint64 pending;
   QByteArray buffer;
   bool eof;
+  qint64 received;
+  qint64 spillThreshold;
+  int fd;
+  qint64 readOffset;
+  qint64 writeOffset;
+  uchar *map;
 };
 
 #endif  /* QFCGI_STREAM_H */
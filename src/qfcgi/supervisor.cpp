@@ -0,0 +1,201 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "supervisor.h"
+
+/*
+ * Milliseconds to wait before a crashed worker process is respawned.
+ */
+#define RESPAWN_DELAY 1000
+
+static int signalPipe[2] = { -1, -1 };
+
+static void signalHandler(int signo) {
+  int savedErrno = errno;
+  char c = signo;
+
+  if (write(signalPipe[1], &c, 1) < 0) {
+    // nothing to do in a signal handler
+  }
+
+  errno = savedErrno;
+}
+
+QFCgiSupervisor::QFCgiSupervisor(int processCount, QObject *parent) : QObject(parent) {
+  this->processCount = processCount;
+  this->supervising = false;
+  this->draining = false;
+  this->notifier = 0;
+}
+
+QFCgiSupervisor::~QFCgiSupervisor() {
+}
+
+bool QFCgiSupervisor::isSupervising() const {
+  return this->supervising;
+}
+
+bool QFCgiSupervisor::start() {
+  this->supervising = true;
+
+  if (!installSignalHandlers()) {
+    this->supervising = false;
+    return false;
+  }
+
+  qDebug("FastCGI supervisor started, forking %d worker processes", this->processCount);
+
+  for (int i = 0; i < this->processCount && this->supervising; i++) {
+    spawn();
+  }
+
+  return true;
+}
+
+void QFCgiSupervisor::spawn() {
+  if (!this->supervising || this->draining) {
+    return;
+  }
+
+  pid_t pid = fork();
+
+  if (pid > 0) {
+    this->pids.insert(pid);
+    qDebug("FastCGI worker process %d started", pid);
+  } else if (pid == 0) {
+    // the worker process only needs its own SIGTERM handling
+    this->supervising = false;
+    this->pids.clear();
+    installSignalHandlers();
+
+    emit processStarted();
+  } else {
+    qDebug("fork: %s", strerror(errno));
+    QTimer::singleShot(RESPAWN_DELAY, this, SLOT(spawn()));
+  }
+}
+
+void QFCgiSupervisor::onSignal() {
+  char signos[16];
+  ssize_t nread = read(signalPipe[0], signos, sizeof(signos));
+
+  for (ssize_t i = 0; i < nread; i++) {
+    if (signos[i] == SIGCHLD && this->supervising) {
+      reap();
+    } else if (signos[i] == SIGTERM && this->supervising) {
+      qDebug("FastCGI supervisor draining %d worker processes", this->pids.size());
+      this->draining = true;
+
+      Q_FOREACH(int pid, this->pids) {
+        kill(pid, SIGTERM);
+      }
+    } else if (signos[i] == SIGTERM) {
+      emit terminate();
+    }
+
+    if (!this->supervising) {
+      // a respawned worker process, the rest belongs to the supervisor
+      return;
+    }
+  }
+
+  if (this->draining && this->pids.isEmpty()) {
+    qDebug("FastCGI supervisor finished");
+    QCoreApplication::exit(0);
+  }
+}
+
+bool QFCgiSupervisor::installSignalHandlers() {
+  // a forked worker process must not share the pipe with the supervisor
+  if (signalPipe[0] != -1) {
+    // A respawned worker process still runs in the activated() signal of the
+    // notifier, it is deleted when control returns to the event loop.
+    this->notifier->setEnabled(false);
+    this->notifier->disconnect(this);
+    this->notifier->deleteLater();
+    ::close(signalPipe[0]);
+    ::close(signalPipe[1]);
+  }
+
+  if (pipe(signalPipe) != 0) {
+    qDebug("pipe: %s", strerror(errno));
+    return false;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    fcntl(signalPipe[i], F_SETFD, FD_CLOEXEC);
+    fcntl(signalPipe[i], F_SETFL, fcntl(signalPipe[i], F_GETFL) | O_NONBLOCK);
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = signalHandler;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+
+  sigaction(SIGTERM, &sa, 0);
+
+  if (this->supervising) {
+    sigaction(SIGCHLD, &sa, 0);
+  } else {
+    signal(SIGCHLD, SIG_DFL);
+  }
+
+  this->notifier = new QSocketNotifier(signalPipe[0], QSocketNotifier::Read, this);
+  connect(this->notifier, SIGNAL(activated(int)), this, SLOT(onSignal()));
+
+  return true;
+}
+
+void QFCgiSupervisor::reap() {
+  pid_t pid;
+  int status;
+
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    if (!this->pids.remove(pid)) {
+      continue;
+    }
+
+    bool crashed = WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0);
+    qDebug("FastCGI worker process %d %s", pid, crashed ? "crashed" : "exited");
+
+    if (this->draining) {
+      continue;
+    } else if (crashed) {
+      // do not spin, if the worker keeps crashing
+      QTimer::singleShot(RESPAWN_DELAY, this, SLOT(spawn()));
+    } else {
+      spawn();
+
+      if (!this->supervising) {
+        return;
+      }
+    }
+  }
+}
@@ -0,0 +1,61 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QFCGI_SUPERVISOR_H
+#define QFCGI_SUPERVISOR_H
+
+#include <QObject>
+#include <QSet>
+
+class QSocketNotifier;
+
+/*
+ * Forks the worker processes and respawns them, when they exit. On SIGTERM
+ * the workers are asked to drain, the supervisor exits after the last one.
+ *
+ * In a worker process the instance only forwards SIGTERM as terminate().
+ */
+class QFCgiSupervisor : public QObject {
+  Q_OBJECT
+
+public:
+  QFCgiSupervisor(int processCount, QObject *parent = 0);
+  virtual ~QFCgiSupervisor();
+
+  bool isSupervising() const;
+  bool start();
+
+signals:
+  void processStarted();
+  void terminate();
+
+private slots:
+  void onSignal();
+  void spawn();
+
+private:
+  bool installSignalHandlers();
+  void reap();
+
+  int processCount;
+  bool supervising;
+  bool draining;
+  QSet<int> pids;
+  QSocketNotifier *notifier;
+};
+
+#endif  /* QFCGI_SUPERVISOR_H */
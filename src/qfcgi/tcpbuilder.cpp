@@ -15,47 +15,106 @@
  * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <QTcpServer>
-#include <QTcpSocket>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
 
-#include "connection.h"
-#include "fcgi.h"
 #include "tcpbuilder.h"
 
-QFCgiTcpConnectionBuilder::QFCgiTcpConnectionBuilder(const QHostAddress &address, quint16 port, QObject *parent)
+static bool setReusePort(int fd) {
+#ifdef SO_REUSEPORT
+  int on = 1;
+  return setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == 0;
+#else
+  Q_UNUSED(fd);
+  return false;
+#endif
+}
+
+QFCgiTcpConnectionBuilder::QFCgiTcpConnectionBuilder(const QHostAddress &address, quint16 port, bool reusePort, QObject *parent)
   : QFCgiConnectionBuilder(parent) {
 
-  this->server = new QTcpServer(this);
   this->address = address;
   this->port = port;
+  this->reusePort = reusePort;
 }
 
 QFCgiTcpConnectionBuilder::~QFCgiTcpConnectionBuilder() {
 }
 
 bool QFCgiTcpConnectionBuilder::listen() {
-  if (this->server->listen(this->address, this->port)) {
-    connect(this->server, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
-    qDebug("FastCGI application started, listening on %s/%d",
-      qPrintable(this->server->serverAddress().toString()),
-      this->server->serverPort());
-    return true;
-  } else {
+  int fd = createListenSocket();
+
+  if (fd == -1) {
     return false;
   }
+
+  startAccepting(fd, true);
+  qDebug("FastCGI application started, listening on %s/%d%s",
+    qPrintable(this->address.toString()), this->port,
+    this->reusePort ? " (SO_REUSEPORT)" : "");
+
+  return true;
 }
 
-bool QFCgiTcpConnectionBuilder::isListening() const {
-  return this->server->isListening();
+QFCgiConnectionBuilder::SocketType QFCgiTcpConnectionBuilder::getSocketType() const {
+  return TcpSocket;
 }
 
-QString QFCgiTcpConnectionBuilder::errorString() const {
-  return this->server->errorString();
+QFCgiConnectionBuilder* QFCgiTcpConnectionBuilder::createWorkerBuilder() const {
+  if (this->reusePort) {
+    return new QFCgiTcpConnectionBuilder(this->address, this->port, true, 0);
+  } else {
+    return 0;
+  }
 }
 
-void QFCgiTcpConnectionBuilder::onNewConnection() {
-  QFCgi *fcgi = qobject_cast<QFCgi*>(parent());
-  QTcpSocket *so = this->server->nextPendingConnection();
-  QFCgiConnection *connection = new QFCgiConnection(so, fcgi);
-  emit newConnection(connection);
+int QFCgiTcpConnectionBuilder::createListenSocket() {
+  struct sockaddr_storage ss;
+  socklen_t len;
+
+  memset(&ss, 0, sizeof(ss));
+
+  if (this->address.protocol() == QAbstractSocket::IPv6Protocol) {
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6*)&ss;
+    Q_IPV6ADDR addr = this->address.toIPv6Address();
+
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port = htons(this->port);
+    memcpy(&sin6->sin6_addr, &addr, sizeof(sin6->sin6_addr));
+    len = sizeof(struct sockaddr_in6);
+  } else {
+    struct sockaddr_in *sin = (struct sockaddr_in*)&ss;
+
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(this->port);
+    sin->sin_addr.s_addr = htonl(this->address.toIPv4Address());
+    len = sizeof(struct sockaddr_in);
+  }
+
+  int fd = socket(ss.ss_family, SOCK_STREAM, 0);
+  int on = 1;
+
+  if (fd == -1) {
+    setErrorString(QString::fromLocal8Bit(strerror(errno)));
+    return -1;
+  }
+
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0) {
+    setErrorString(QString::fromLocal8Bit(strerror(errno)));
+  } else if (this->reusePort && !setReusePort(fd)) {
+    setErrorString("SO_REUSEPORT is not supported");
+  } else if (bind(fd, (struct sockaddr*)&ss, len) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+    setErrorString(QString::fromLocal8Bit(strerror(errno)));
+  } else {
+    return fd;
+  }
+
+  ::close(fd);
+  return -1;
 }
@@ -20,28 +20,25 @@
 
 #include <QHostAddress>
 
-class QTcpServer;
-
 #include "builder.h"
 
 class QFCgiTcpConnectionBuilder : public QFCgiConnectionBuilder {
   Q_OBJECT
 
 public:
-  QFCgiTcpConnectionBuilder(const QHostAddress &address, quint16 port, QObject *parent);
+  QFCgiTcpConnectionBuilder(const QHostAddress &address, quint16 port, bool reusePort, QObject *parent);
   virtual ~QFCgiTcpConnectionBuilder();
 
   bool listen();
-  bool isListening() const;
-  QString errorString() const;
-
-private slots:
-  void onNewConnection();
+  SocketType getSocketType() const;
+  QFCgiConnectionBuilder* createWorkerBuilder() const;
 
 private:
-  QTcpServer *server;
+  int createListenSocket();
+
   QHostAddress address;
   quint16 port;
+  bool reusePort;
 };
 
 #endif  /* QFCGI_TCP_BUILDER_H */
@@ -0,0 +1,88 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QFCGI_TRACE_H
+#define QFCGI_TRACE_H
+
+/*
+ * Static tracepoints of the provider "qfcgi", for perf, bpftrace, SystemTap
+ * and friends. They are attached to the running process, for example:
+ *
+ *   bpftrace -e 'usdt:/usr/lib/libqfcgi.so:qfcgi:request_end { ... }'
+ *
+ * An unused tracepoint is a single nop. Without <sys/sdt.h> they compile to
+ * nothing and their arguments are not evaluated.
+ */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define QFCGI_TRACE1(name, a1) DTRACE_PROBE1(qfcgi, name, a1)
+#define QFCGI_TRACE2(name, a1, a2) DTRACE_PROBE2(qfcgi, name, a1, a2)
+#define QFCGI_TRACE3(name, a1, a2, a3) DTRACE_PROBE3(qfcgi, name, a1, a2, a3)
+#define QFCGI_TRACE4(name, a1, a2, a3, a4) DTRACE_PROBE4(qfcgi, name, a1, a2, a3, a4)
+#else
+#define QFCGI_TRACE1(name, a1) do {} while (0)
+#define QFCGI_TRACE2(name, a1, a2) do {} while (0)
+#define QFCGI_TRACE3(name, a1, a2, a3) do {} while (0)
+#define QFCGI_TRACE4(name, a1, a2, a3, a4) do {} while (0)
+#endif
+
+/*
+ * A connection was taken over: connection-id, socket descriptor (-1 if the
+ * device is not a socket)
+ */
+#define QFCGI_TRACE_CONNECTION_ACCEPT(conn, fd) QFCGI_TRACE2(connection_accept, conn, fd)
+
+/*
+ * A connection is destroyed: connection-id
+ */
+#define QFCGI_TRACE_CONNECTION_CLOSE(conn) QFCGI_TRACE1(connection_close, conn)
+
+/*
+ * A record was read from the web server: connection-id, request-id, type,
+ * content-length
+ */
+#define QFCGI_TRACE_RECORD_PARSED(conn, id, type, length) QFCGI_TRACE4(record_parsed, conn, id, type, length)
+
+/*
+ * A record was moved into the output of the connection: connection-id,
+ * request-id, type, content-length
+ */
+#define QFCGI_TRACE_RECORD_SENT(conn, id, type, length) QFCGI_TRACE4(record_sent, conn, id, type, length)
+
+/*
+ * A request was admitted: connection-id, request-id, keep-connection flag
+ */
+#define QFCGI_TRACE_REQUEST_BEGIN(conn, id, keepConn) QFCGI_TRACE3(request_begin, conn, id, keepConn)
+
+/*
+ * All parameters of a request are received, the application gets the
+ * request: connection-id, request-id
+ */
+#define QFCGI_TRACE_REQUEST_PARAMS_COMPLETE(conn, id) QFCGI_TRACE2(request_params_complete, conn, id)
+
+/*
+ * The input of a request is complete: connection-id, request-id
+ */
+#define QFCGI_TRACE_REQUEST_STDIN_EOF(conn, id) QFCGI_TRACE2(request_stdin_eof, conn, id)
+
+/*
+ * A request has ended: connection-id, request-id, aborted flag
+ */
+#define QFCGI_TRACE_REQUEST_END(conn, id, aborted) QFCGI_TRACE3(request_end, conn, id, aborted)
+
+#endif  /* QFCGI_TRACE_H */
@@ -0,0 +1,161 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QLocalSocket>
+#include <QTcpSocket>
+#include <QThread>
+
+#include <unistd.h>
+
+#include "builder.h"
+#include "connection.h"
+#include "fcgi.h"
+#include "worker.h"
+
+QFCgiWorker::QFCgiWorker(QFCgi *fcgi, QObject *parent) : QObject(parent) {
+  this->fcgi = fcgi;
+  this->builder = 0;
+  this->listening = false;
+  this->draining = false;
+}
+
+QFCgiWorker::~QFCgiWorker() {
+}
+
+int QFCgiWorker::getConnectionCount() const {
+  return this->connections;
+}
+
+QFCgiStats QFCgiWorker::getStats() const {
+  if (thread() == QThread::currentThread() || !thread()->isRunning()) {
+    return this->stats;
+  }
+
+  // the counters are only read on the thread writing them
+  QFCgiStats result;
+  QMetaObject::invokeMethod(const_cast<QFCgiWorker*>(this), "takeStats", Qt::BlockingQueuedConnection,
+                            Q_RETURN_ARG(QFCgiStats, result));
+
+  return result;
+}
+
+void QFCgiWorker::dispatch(int descriptor, int socketType) {
+  // counted right away, the next dispatch already sees the connection
+  this->connections.ref();
+
+  QMetaObject::invokeMethod(this, "addConnection", Qt::AutoConnection,
+                            Q_ARG(int, descriptor), Q_ARG(int, socketType));
+}
+
+bool QFCgiWorker::listen(QFCgiConnectionBuilder *builder) {
+  // the builder accepts on the thread of the worker
+  this->builder = builder;
+  this->builder->moveToThread(thread());
+
+  bool result;
+  Qt::ConnectionType type = (thread() == QThread::currentThread()) ? Qt::DirectConnection : Qt::BlockingQueuedConnection;
+  QMetaObject::invokeMethod(this, "startListening", type, Q_RETURN_ARG(bool, result));
+
+  return result;
+}
+
+bool QFCgiWorker::isListening() const {
+  return this->listening;
+}
+
+QString QFCgiWorker::errorString() const {
+  return this->error;
+}
+
+bool QFCgiWorker::startListening() {
+  this->builder->setParent(this);
+  this->listening = this->builder->listen();
+
+  if (this->listening) {
+    connect(this->builder, SIGNAL(newConnection(int)), this, SLOT(onNewConnection(int)));
+  } else {
+    this->error = this->builder->errorString();
+  }
+
+  return this->listening;
+}
+
+QFCgiStats QFCgiWorker::takeStats() const {
+  return this->stats;
+}
+
+void QFCgiWorker::onNewConnection(int descriptor) {
+  if (!this->fcgi->admitConnection()) {
+    ::close(descriptor);
+    return;
+  }
+
+  this->connections.ref();
+  addConnection(descriptor, this->builder->getSocketType());
+}
+
+void QFCgiWorker::addConnection(int descriptor, int socketType) {
+  QIODevice *device;
+  bool valid;
+
+  if (socketType == QFCgiConnectionBuilder::TcpSocket) {
+    QTcpSocket *so = new QTcpSocket;
+    valid = so->setSocketDescriptor(descriptor);
+    device = so;
+  } else {
+    QLocalSocket *so = new QLocalSocket;
+    valid = so->setSocketDescriptor(descriptor, QLocalSocket::ConnectedState, QIODevice::ReadWrite);
+    device = so;
+  }
+
+  if (!valid) {
+    qDebug("failed to take over socket %d: %s", descriptor, qPrintable(device->errorString()));
+    delete device;
+    ::close(descriptor);
+    this->connections.deref();
+    this->fcgi->releaseConnection();
+    return;
+  }
+
+  QFCgiConnection *connection = new QFCgiConnection(device, this->fcgi, &this->stats, this);
+  connect(connection, SIGNAL(destroyed()), this, SLOT(onConnectionDestroyed()));
+
+  if (this->draining) {
+    // dispatched before the drain started
+    connection->drain();
+  }
+
+  qDebug("[%d] FastCGI connection accepted", connection->getId());
+}
+
+void QFCgiWorker::onConnectionDestroyed() {
+  this->connections.deref();
+  this->fcgi->releaseConnection();
+  emit connectionClosed();
+}
+
+void QFCgiWorker::drain() {
+  this->draining = true;
+
+  if (this->builder != 0) {
+    this->builder->close();
+  }
+
+  Q_FOREACH(QFCgiConnection *connection, findChildren<QFCgiConnection*>()) {
+    connection->drain();
+  }
+}
@@ -0,0 +1,74 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QFCGI_WORKER_H
+#define QFCGI_WORKER_H
+
+#include <QAtomicInt>
+#include <QObject>
+
+#include "stats.h"
+
+class QFCgi;
+class QFCgiConnectionBuilder;
+
+/*
+ * Serves connections on the thread the worker lives in. Sockets are
+ * #dispatch()ed from the accepting thread, the worker creates the
+ * QFCgiConnection on its own thread.
+ *
+ * The statistics of the worker are written by its connections only, thus
+ * from a single thread and without locking. #getStats() takes the snapshot on
+ * that thread as well.
+ */
+class QFCgiWorker : public QObject {
+  Q_OBJECT
+
+public:
+  QFCgiWorker(QFCgi *fcgi, QObject *parent = 0);
+  virtual ~QFCgiWorker();
+
+  int getConnectionCount() const;
+  QFCgiStats getStats() const;
+  void dispatch(int descriptor, int socketType);
+
+  bool listen(QFCgiConnectionBuilder *builder);
+  bool isListening() const;
+  QString errorString() const;
+
+signals:
+  void connectionClosed();
+
+private slots:
+  bool startListening();
+  QFCgiStats takeStats() const;
+  void addConnection(int descriptor, int socketType);
+  void onNewConnection(int descriptor);
+  void onConnectionDestroyed();
+  void drain();
+
+private:
+  QFCgi *fcgi;
+  QFCgiConnectionBuilder *builder;
+  bool listening;
+  bool draining;
+  QString error;
+  QAtomicInt connections;
+  QFCgiStats stats;
+};
+
+#endif  /* QFCGI_WORKER_H */
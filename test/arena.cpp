@@ -0,0 +1,106 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest/QtTest>
+
+#include "../src/qfcgi/arena.h"
+
+class ArenaTest: public QObject {
+  Q_OBJECT
+
+private slots:
+  void init() {
+    this->arena = new QFCgiArena(16);
+  }
+
+  void cleanup() {
+    delete this->arena;
+  }
+
+  void empty() {
+    QCOMPARE(arena->getAllocationCount(), 0);
+  }
+
+  void allocateSameBlock() {
+    char *a = arena->allocate(4);
+    char *b = arena->allocate(12);
+
+    QVERIFY(b == a + 4);
+    QCOMPARE(arena->getAllocationCount(), 1);
+  }
+
+  void allocateNextBlock() {
+    char *a = arena->allocate(12);
+    char *b = arena->allocate(8);
+
+    QVERIFY(b != a + 12);
+    QCOMPARE(arena->getAllocationCount(), 2);
+  }
+
+  void allocateLarge() {
+    char *a = arena->allocate(100);
+    memset(a, 'x', 100);
+
+    QCOMPARE(arena->getAllocationCount(), 1);
+  }
+
+  void resetKeepsFirstBlock() {
+    char *a = arena->allocate(12);
+    arena->allocate(12);
+    arena->reset();
+
+    QVERIFY(arena->allocate(12) == a);
+    QCOMPARE(arena->getAllocationCount(), 2);
+  }
+
+  void allocateGrowing() {
+    QFCgiArena growing(16, 64);
+    growing.allocate(12);
+    char *b = growing.allocate(12);
+    char *c = growing.allocate(20);
+
+    // the second block has twice the size
+    QVERIFY(c == b + 12);
+    QCOMPARE(growing.getAllocationCount(), 2);
+  }
+
+  void resetDropsLargeFirstBlock() {
+    arena->allocate(100);
+    arena->reset();
+    arena->allocate(12);
+
+    QCOMPARE(arena->getAllocationCount(), 2);
+  }
+
+  void releaseFrontBlocks() {
+    arena->allocate(12);
+    arena->allocate(12);
+    char *c = arena->allocate(12);
+    arena->release(c);
+    arena->reset();
+
+    // the block still in use is the first one now
+    QVERIFY(arena->allocate(12) == c);
+    QCOMPARE(arena->getAllocationCount(), 3);
+  }
+
+private:
+  QFCgiArena *arena;
+};
+
+QTEST_MAIN(ArenaTest)
+#include "arena.moc"
@@ -0,0 +1,109 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest/QtTest>
+
+#include "../src/qfcgi/buffer.h"
+
+class BufferTest: public QObject {
+  Q_OBJECT
+
+private slots:
+  void init() {
+    this->buffer = new QFCgiBuffer;
+  }
+
+  void cleanup() {
+    delete this->buffer;
+  }
+
+  void empty() {
+    QVERIFY(buffer->isEmpty());
+    QCOMPARE(buffer->size(), 0);
+  }
+
+  void append() {
+    buffer->append("123", 3);
+    QVERIFY(!buffer->isEmpty());
+    QCOMPARE(buffer->size(), 3);
+    QVERIFY(memcmp(buffer->data(), "123", 3) == 0);
+  }
+
+  void consume() {
+    buffer->append("12345", 5);
+    buffer->consume(2);
+    QCOMPARE(buffer->size(), 3);
+    QVERIFY(memcmp(buffer->data(), "345", 3) == 0);
+  }
+
+  void consumeAll() {
+    buffer->append("123", 3);
+    buffer->consume(3);
+    QVERIFY(buffer->isEmpty());
+  }
+
+  void consumeTooMuch() {
+    buffer->append("123", 3);
+    buffer->consume(4);
+    QVERIFY(buffer->isEmpty());
+  }
+
+  void appendAfterConsume() {
+    buffer->append("12345", 5);
+    buffer->consume(3);
+    buffer->append("678", 3);
+    QCOMPARE(buffer->size(), 5);
+    QVERIFY(memcmp(buffer->data(), "45678", 5) == 0);
+  }
+
+  void appendGrow() {
+    QByteArray ba(100000, 'x');
+
+    buffer->append("1", 1);
+    buffer->append(ba.constData(), ba.size());
+    buffer->consume(1);
+    QCOMPARE(buffer->size(), ba.size());
+    QVERIFY(memcmp(buffer->data(), ba.constData(), ba.size()) == 0);
+  }
+
+  void reserveCommit() {
+    buffer->append("12", 2);
+    char *data = buffer->reserve(16);
+    memcpy(data, "345", 3);
+    buffer->commit(3);
+    QCOMPARE(buffer->size(), 5);
+    QVERIFY(memcmp(buffer->data(), "12345", 5) == 0);
+  }
+
+  void reserveNoCommit() {
+    buffer->append("12", 2);
+    buffer->reserve(16);
+    QCOMPARE(buffer->size(), 2);
+  }
+
+  void clear() {
+    buffer->append("123", 3);
+    buffer->clear();
+    QVERIFY(buffer->isEmpty());
+  }
+
+private:
+  QFCgiBuffer *buffer;
+};
+
+QTEST_MAIN(BufferTest)
+#include "buffer.moc"
@@ -0,0 +1,87 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QFCGI_TEST_NGINX_HELPER_H
+#define QFCGI_TEST_NGINX_HELPER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+
+/*
+ * Parameters as sent by nginx with its default fastcgi_params for a typical
+ * browser request. A request with a body is sent as POST. Shared by the tests
+ * and the benchmarks.
+ */
+inline QList<QPair<QByteArray, QByteArray> > nginxParams(qint64 contentLength) {
+  static const char *params[][2] = {
+    { "QUERY_STRING", "page=2&sort=date&order=desc" },
+    { "REQUEST_METHOD", 0 },
+    { "CONTENT_TYPE", 0 },
+    { "CONTENT_LENGTH", 0 },
+    { "SCRIPT_NAME", "/index.fcgi" },
+    { "REQUEST_URI", "/index.fcgi/articles?page=2&sort=date&order=desc" },
+    { "DOCUMENT_URI", "/index.fcgi/articles" },
+    { "DOCUMENT_ROOT", "/var/www/html" },
+    { "SERVER_PROTOCOL", "HTTP/1.1" },
+    { "REQUEST_SCHEME", "https" },
+    { "HTTPS", "on" },
+    { "GATEWAY_INTERFACE", "CGI/1.1" },
+    { "SERVER_SOFTWARE", "nginx/1.24.0" },
+    { "REMOTE_ADDR", "203.0.113.57" },
+    { "REMOTE_PORT", "53218" },
+    { "SERVER_ADDR", "198.51.100.10" },
+    { "SERVER_PORT", "443" },
+    { "SERVER_NAME", "www.example.com" },
+    { "REDIRECT_STATUS", "200" },
+    { "SCRIPT_FILENAME", "/var/www/html/index.fcgi" },
+    { "PATH_INFO", "/articles" },
+    { "HTTP_HOST", "www.example.com" },
+    { "HTTP_USER_AGENT", "Mozilla/5.0 (X11; Linux x86_64; rv:121.0) Gecko/20100101 Firefox/121.0" },
+    { "HTTP_ACCEPT", "text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8" },
+    { "HTTP_ACCEPT_LANGUAGE", "en-US,en;q=0.5" },
+    { "HTTP_ACCEPT_ENCODING", "gzip, deflate, br" },
+    { "HTTP_REFERER", "https://www.example.com/index.fcgi/articles?page=1" },
+    { "HTTP_COOKIE", "session=8f14e45fceea167a5a36dedd4bea2543; theme=dark; lang=en" },
+    { "HTTP_CONNECTION", "keep-alive" },
+    { "HTTP_UPGRADE_INSECURE_REQUESTS", "1" },
+    { "HTTP_SEC_FETCH_DEST", "document" },
+    { "HTTP_SEC_FETCH_MODE", "navigate" },
+    { "HTTP_SEC_FETCH_SITE", "same-origin" }
+  };
+
+  QList<QPair<QByteArray, QByteArray> > list;
+
+  for (size_t i = 0; i < sizeof(params) / sizeof(params[0]); i++) {
+    QByteArray name(params[i][0]);
+    QByteArray value(params[i][1]);
+
+    if (name == "REQUEST_METHOD") {
+      value = (contentLength > 0) ? "POST" : "GET";
+    } else if (name == "CONTENT_TYPE" && contentLength > 0) {
+      value = "application/x-www-form-urlencoded";
+    } else if (name == "CONTENT_LENGTH" && contentLength > 0) {
+      value = QByteArray::number(contentLength);
+    }
+
+    list.append(qMakePair(name, value));
+  }
+
+  return list;
+}
+
+#endif  /* QFCGI_TEST_NGINX_HELPER_H */
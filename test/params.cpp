@@ -0,0 +1,215 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest/QtTest>
+
+#include "../src/qfcgi/params.h"
+#include "../src/qfcgi/record.h"
+
+#include "nginx_helper.h"
+#include "param_helper.h"
+
+class ParamsTest: public QObject {
+  Q_OBJECT
+
+private slots:
+  void init() {
+    this->params = new QFCgiParams;
+  }
+
+  void cleanup() {
+    delete this->params;
+  }
+
+  void empty() {
+    QCOMPARE(params->count(), 0);
+    QCOMPARE(params->value("k1"), QString());
+  }
+
+  void consume() {
+    QByteArray ba = encodeParam("k1", "v1").append(encodeParam("k2", "v2"));
+    params->consume(ba.constData(), ba.size());
+
+    QCOMPARE(params->count(), 2);
+    QCOMPARE(params->value("k1"), QString("v1"));
+    QCOMPARE(params->value("k2"), QString("v2"));
+  }
+
+  void consumeDuplicate() {
+    QByteArray ba = encodeParam("k1", "v1").append(encodeParam("k1", "v2"));
+    params->consume(ba.constData(), ba.size());
+
+    QCOMPARE(params->count(), 1);
+    QCOMPARE(params->names().count(), 1);
+    QCOMPARE(params->value("k1"), QString("v2"));
+  }
+
+  void rawValue() {
+    QByteArray ba = encodeParam("k1", "v1").append(encodeParam("k2", "v2"));
+    params->consume(ba.constData(), ba.size());
+
+    QCOMPARE(params->rawValue("k1", 2), QByteArray("v1"));
+    QCOMPARE(params->rawValue("k2", 2), QByteArray("v2"));
+    QVERIFY(params->rawValue("k3", 2).isEmpty());
+    QVERIFY(params->rawValue("k", 1).isEmpty());
+  }
+
+  void wellKnown() {
+    const char *names[] = {
+      "AUTH_TYPE", "CONTENT_LENGTH", "CONTENT_TYPE", "DOCUMENT_ROOT",
+      "DOCUMENT_URI", "GATEWAY_INTERFACE", "HTTPS", "HTTP_ACCEPT",
+      "HTTP_ACCEPT_ENCODING", "HTTP_ACCEPT_LANGUAGE", "HTTP_AUTHORIZATION",
+      "HTTP_CONNECTION", "HTTP_COOKIE", "HTTP_HOST", "HTTP_REFERER",
+      "HTTP_USER_AGENT", "HTTP_X_FORWARDED_FOR", "PATH_INFO",
+      "PATH_TRANSLATED", "QUERY_STRING", "REDIRECT_STATUS", "REMOTE_ADDR",
+      "REMOTE_HOST", "REMOTE_PORT", "REMOTE_USER", "REQUEST_METHOD",
+      "REQUEST_SCHEME", "REQUEST_URI", "SCRIPT_FILENAME", "SCRIPT_NAME",
+      "SERVER_ADDR", "SERVER_NAME", "SERVER_PORT", "SERVER_PROTOCOL",
+      "SERVER_SOFTWARE"
+    };
+    QByteArray ba;
+
+    QCOMPARE((int)(sizeof(names) / sizeof(names[0])), (int)QFCgiParams::NUM_WELL_KNOWN);
+
+    for (int i = 0; i < QFCgiParams::NUM_WELL_KNOWN; i++) {
+      QCOMPARE(QFCgiParams::wellKnownParam(names[i], strlen(names[i])), i);
+      ba.append(encodeParam(names[i], QString::number(i)));
+    }
+
+    params->consume(ba.constData(), ba.size());
+
+    for (int i = 0; i < QFCgiParams::NUM_WELL_KNOWN; i++) {
+      QCOMPARE(params->rawValue((QFCgiRequest::Param)i), QByteArray::number(i));
+      QCOMPARE(params->value(names[i]), QString::number(i));
+    }
+  }
+
+  void wellKnownUnknown() {
+    QCOMPARE(QFCgiParams::wellKnownParam("HTTP", 4), -1);
+    QCOMPARE(QFCgiParams::wellKnownParam("HTTPSX", 6), -1);
+    QCOMPARE(QFCgiParams::wellKnownParam("", 0), -1);
+    QVERIFY(params->rawValue(QFCgiRequest::REQUEST_METHOD).isEmpty());
+  }
+
+  void wellKnownDuplicate() {
+    QByteArray ba = encodeParam("REQUEST_METHOD", "GET").append(encodeParam("REQUEST_METHOD", "POST"));
+    params->consume(ba.constData(), ba.size());
+
+    QCOMPARE(params->count(), 1);
+    QCOMPARE(params->rawValue(QFCgiRequest::REQUEST_METHOD), QByteArray("POST"));
+  }
+
+  void consumeEmptyValue() {
+    QByteArray ba = encodeParam("k1", "");
+    params->consume(ba.constData(), ba.size());
+
+    QCOMPARE(params->count(), 1);
+    QVERIFY(params->names().contains("k1"));
+    QCOMPARE(params->value("k1"), QString(""));
+  }
+
+  void consumeBigLength() {
+    const QString bigValue(300, 'x');
+    QByteArray ba = encodeParam("k1", bigValue);
+    params->consume(ba.constData(), ba.size());
+
+    QCOMPARE(params->count(), 1);
+    QCOMPARE(params->value("k1"), bigValue);
+  }
+
+  void consumeSplit() {
+    const QString bigValue(300, 'x');
+    QByteArray ba = encodeParam("k1", "v123456")
+      .append(encodeParam(bigValue, "v2"))
+      .append(encodeParam("k3", bigValue));
+
+    // split the stream at every possible position
+    for (int i = 0; i <= ba.size(); i++) {
+      params->clear();
+      params->consume(ba.constData(), i);
+      params->consume(ba.constData() + i, ba.size() - i);
+
+      QCOMPARE(params->count(), 3);
+      QCOMPARE(params->value("k1"), QString("v123456"));
+      QCOMPARE(params->value(bigValue), QString("v2"));
+      QCOMPARE(params->value("k3"), bigValue);
+    }
+  }
+
+  void consumeByteByByte() {
+    QByteArray ba = encodeParam("k1", "v1").append(encodeParam("k2", QString(200, 'x')));
+
+    for (int i = 0; i < ba.size(); i++) {
+      params->consume(ba.constData() + i, 1);
+    }
+
+    QCOMPARE(params->count(), 2);
+    QCOMPARE(params->value("k1"), QString("v1"));
+    QCOMPARE(params->value("k2"), QString(200, 'x'));
+  }
+
+  void consumeIncomplete() {
+    QByteArray ba = encodeParam("k1", "v1");
+    params->consume(ba.constData(), ba.size() - 1);
+
+    QCOMPARE(params->count(), 0);
+  }
+
+  void consumeOversizedLength() {
+    // a pair of 2 GiB, only its header arrives
+    QByteArray ba = QByteArray("\x02\xff\xff\xff\xff" "k1", 7);
+
+    QVERIFY(!params->consume(ba.constData(), ba.size()));
+    QCOMPARE(params->count(), 0);
+  }
+
+  void consumeOversizedLengthSplit() {
+    // the length fields arrive byte by byte, the pair is rejected once they are complete
+    QByteArray ba = QByteArray("\x82\x00\x00\x00\xff\xff\xff\xff" "k1", 10);
+
+    for (int i = 0; i < 7; i++) {
+      QVERIFY(params->consume(ba.constData() + i, 1));
+    }
+
+    QVERIFY(!params->consume(ba.constData() + 7, ba.size() - 7));
+    QCOMPARE(params->count(), 0);
+  }
+
+  void consumeOversizedValue() {
+    // an honest pair, which is too large for the parameters
+    QByteArray ba = encodeParam("k1", QString(2 * 1024 * 1024, 'x'));
+
+    QVERIFY(!params->consume(ba.constData(), 1024));
+  }
+
+  void benchmarkNginx() {
+    QByteArray ba = QFCgiRecord::createParams(1, nginxParams(0)).getContent();
+
+    QBENCHMARK {
+      params->clear();
+      params->consume(ba.constData(), ba.size());
+    }
+
+    QCOMPARE(params->count(), 33);
+  }
+
+private:
+  QFCgiParams *params;
+};
+
+QTEST_MAIN(ParamsTest)
+#include "params.moc"
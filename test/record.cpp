@@ -68,7 +68,13 @@ private slots:
   }
 
   void readInvalidType() {
-    QVERIFY(record->read(binaryRecord(1, 12, 0, QByteArray())) == -1);
+    QVERIFY(record->read(binaryRecord(1, 12, 1, QByteArray())) == -1);
+  }
+
+  void readUnknownManagementType() {
+    QVERIFY(record->read(binaryRecord(1, 200, 0, QByteArray())) == 8);
+    QVERIFY(record->getType() == QFCgiRecord::FCGI_UNKNOWN_TYPE);
+    QVERIFY(record->getRawType() == 200);
   }
 
   void readNoContent() {
@@ -95,11 +101,56 @@ private slots:
     QVERIFY(record->getContent() == QByteArray("12345", 5));
   }
 
+  void readRaw() {
+    QByteArray ba = binaryRecord(1, 2, 3, QByteArray("12345", 5));
+    QVERIFY(record->read(ba.constData(), ba.size()) == 16);
+    QVERIFY(record->getType() == QFCgiRecord::FCGI_ABORT_REQUEST);
+    QVERIFY(record->getRequestId() == 3);
+    QVERIFY(record->getContent() == QByteArray("12345", 5));
+    QVERIFY(record->getContent().constData() == ba.constData() + 8);
+  }
+
+  void readRawIncomplete() {
+    QByteArray ba = binaryRecord(1, 2, 3, QByteArray("12345", 5));
+    QVERIFY(record->read(ba.constData(), 7) == 0);
+    QVERIFY(record->read(ba.constData(), 15) == 0);
+  }
+
   void writeEmptyContent() {
     QVERIFY(record->write(this->buffer) == 8);
     QVERIFY(buffer->buffer() == binaryRecord(1, 11, 0, QByteArray()));
   }
 
+  void encodeHeader() {
+    char header[8];
+    QFCgiRecord r = QFCgiRecord::createOutStream(99, QByteArray("123", 3));
+    QVERIFY(r.encodeHeader(header) == 5);
+    QVERIFY(QByteArray(header, 8) == binaryRecord(1, 6, 99, QByteArray("123", 3)).left(8));
+  }
+
+  void createBeginRequest() {
+    QFCgiRecord r = QFCgiRecord::createBeginRequest(99, FCGI_RESPONDER, true);
+    QVERIFY(r.write(buffer) == 16);
+    QVERIFY(buffer->buffer() == binaryRecord(1, 1, 99, QByteArray("\0\1\1\0\0\0\0\0", 8)));
+  }
+
+  void createParams() {
+    QList<QPair<QByteArray, QByteArray> > params;
+    params.append(qMakePair(QByteArray("REQUEST_METHOD"), QByteArray("GET")));
+    params.append(qMakePair(QByteArray("HTTPS"), QByteArray()));
+
+    QFCgiRecord r = QFCgiRecord::createParams(99, params);
+    QVERIFY(r.write(buffer) == 40);
+    QVERIFY(buffer->buffer() == binaryRecord(1, 4, 99, QByteArray("\x0e\x03" "REQUEST_METHOD" "GET"
+                                                                   "\x05\x00" "HTTPS", 26)));
+  }
+
+  void createInStreamWithData() {
+    QFCgiRecord r = QFCgiRecord::createInStream(99, QByteArray("123", 3));
+    QVERIFY(r.write(buffer) == 16);
+    QVERIFY(buffer->buffer() == binaryRecord(1, 5, 99, QByteArray("123", 3)));
+  }
+
   void createEndRequest() {
     QFCgiRecord r = QFCgiRecord::createEndRequest(99, 1, QFCgiRecord::FCGI_OVERLOADED);
     QVERIFY(r.write(buffer) == 16);
@@ -142,6 +193,23 @@ private slots:
     QVERIFY(buffer->buffer() == binaryRecord(1, 8, 99, QByteArray()));
   }
 
+  void createGetValuesResult() {
+    QList<QPair<QByteArray, QByteArray> > values;
+    values.append(qMakePair(QByteArray("FCGI_MAX_CONNS"), QByteArray("10")));
+    values.append(qMakePair(QByteArray("FCGI_MPXS_CONNS"), QByteArray("1")));
+
+    QFCgiRecord r = QFCgiRecord::createGetValuesResult(values);
+    QVERIFY(r.write(buffer) == 48);
+    QVERIFY(buffer->buffer() == binaryRecord(1, 10, 0, QByteArray("\x0e\x02" "FCGI_MAX_CONNS" "10"
+                                                                  "\x0f\x01" "FCGI_MPXS_CONNS" "1")));
+  }
+
+  void createUnknownType() {
+    QFCgiRecord r = QFCgiRecord::createUnknownType(99);
+    QVERIFY(r.write(buffer) == 16);
+    QVERIFY(buffer->buffer() == binaryRecord(1, 11, 0, QByteArray("\x63\0\0\0\0\0\0\0", 8)));
+  }
+
 private:
   QFCgiRecord *record;
   QBuffer *buffer;
@@ -52,6 +52,10 @@ QByteArray binaryParam(quint16 requestId, const QByteArray &params) {
   return binaryRecord(1, 4, requestId, params);
 }
 
+QByteArray binaryStdin(quint16 requestId, const QByteArray &data) {
+  return binaryRecord(1, 5, requestId, data);
+}
+
 void verifyEnvelope(QIODevice *dev, quint8 type, quint16 requestId, quint16 *contentLength, quint8 *paddingLength) {
   char data[8] = { 0 };
 
@@ -66,6 +70,16 @@ void verifyEnvelope(QIODevice *dev, quint8 type, quint16 requestId, quint16 *con
   // data[7] := reserved
 }
 
+void verifyStream(QIODevice *dev, quint8 type, quint16 requestId, const QByteArray &content) {
+  quint16 contentLength;
+  quint8 paddingLength;
+
+  verifyEnvelope(dev, type, requestId, &contentLength, &paddingLength);
+  QVERIFY(contentLength == content.size());
+  QVERIFY(dev->read(contentLength) == content);
+  QVERIFY(dev->read(paddingLength).size() == paddingLength);
+}
+
 void verifyEndRequest(QIODevice *dev, quint16 requestId, quint32 appStatus, quint8 protocolStatus) {
   quint16 contentLength;
   quint8 paddingLength;
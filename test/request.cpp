@@ -25,6 +25,17 @@
 #include "param_helper.h"
 #include "record_helper.h"
 
+class WorkerHandler: public QObject {
+  Q_OBJECT
+
+public slots:
+  void onNewRequest(QFCgiRequest *request) {
+    bool worker = (QThread::currentThread() != QCoreApplication::instance()->thread());
+    request->getOut()->write(worker ? "worker" : "main");
+    request->endRequest(0);
+  }
+};
+
 class RequestTest: public QObject {
   Q_OBJECT
 
@@ -60,7 +71,7 @@ private slots:
   }
 
   void closeConnectionOnInvalidRequestId() {
-    QVERIFY(this->so->write(binaryRecord(1, 2, 3, QByteArray())) > 0);
+    QVERIFY(this->so->write(binaryRecord(1, 5, 3, QByteArray())) > 0);
 
     QObject::connect(this->so, SIGNAL(disconnected()), loop, SLOT(quit()));
     loop->exec();
@@ -125,6 +136,42 @@ private slots:
     request->endRequest(0);
   }
 
+  void newRequestRecycled() {
+    QVERIFY(this->so->write(binaryBeginRequest(1, 1, 1)) > 0);
+    QVERIFY(this->so->write(binaryParam(1, encodeParam("A", "1"))) > 0);
+    QVERIFY(this->so->write(binaryParam(1, QByteArray())) > 0);
+
+    QSignalSpy spy(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)));
+    QObject::connect(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)), loop, SLOT(quit()));
+    loop->exec();
+
+    QFCgiRequest *first = qvariant_cast<QFCgiRequest*>(spy.at(0).at(0));
+    QCOMPARE(first->getParams().count(), 1);
+    first->endRequest(0);
+
+    QObject::connect(this->so, SIGNAL(readyRead()), loop, SLOT(quit()));
+    while (this->so->bytesAvailable() < 32) {
+      loop->exec();
+    }
+
+    verifyStream(this->so, 6, 1, QByteArray());
+    verifyStream(this->so, 7, 1, QByteArray());
+    verifyEndRequest(this->so, 1, 0, 0);
+    QObject::disconnect(this->so, SIGNAL(readyRead()), loop, SLOT(quit()));
+
+    // the request-id is reused on the same connection
+    QVERIFY(this->so->write(binaryBeginRequest(1, 1, 1)) > 0);
+    QVERIFY(this->so->write(binaryParam(1, QByteArray())) > 0);
+    loop->exec();
+
+    QCOMPARE(spy.count(), 2);
+    QFCgiRequest *second = qvariant_cast<QFCgiRequest*>(spy.at(1).at(0));
+    QVERIFY(second == first);
+    QCOMPARE(second->getParams().count(), 0);
+
+    second->endRequest(0);
+  }
+
   void newRequestParamsOneRecord() {
     QVERIFY(this->so->write(binaryBeginRequest(1, 1, 0)) > 0);
 
@@ -142,6 +189,32 @@ private slots:
     QCOMPARE(request->getParams().count(), 2);
     QCOMPARE(request->getParam("k1"), QString("v1"));
     QCOMPARE(request->getParam("k2"), QString("v2"));
+    QCOMPARE(request->getParamRaw("k1"), QByteArray("v1"));
+    QCOMPARE(request->getParamRaw("k2"), QByteArray("v2"));
+    QCOMPARE(request->getParam(QFCgiRequest::REQUEST_METHOD), QString());
+
+    request->endRequest(0);
+  }
+
+  void newRequestParamsWellKnown() {
+    QVERIFY(this->so->write(binaryBeginRequest(1, 1, 0)) > 0);
+
+    QByteArray params = encodeParam("REQUEST_METHOD", "GET").append(encodeParam("k2", "v2"));
+    QVERIFY(this->so->write(binaryParam(1, params)) > 0);
+    QVERIFY(this->so->write(binaryParam(1, QByteArray())) > 0);
+
+    QSignalSpy spy(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)));
+    QObject::connect(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)), loop, SLOT(quit()));
+    loop->exec();
+
+    QFCgiRequest *request = qvariant_cast<QFCgiRequest*>(spy.at(0).at(0));
+    QVERIFY(request != 0);
+
+    QCOMPARE(request->getParams().count(), 2);
+    QCOMPARE(request->getParam(QFCgiRequest::REQUEST_METHOD), QString("GET"));
+    QCOMPARE(request->getParamRaw(QFCgiRequest::REQUEST_METHOD), QByteArray("GET"));
+    QCOMPARE(request->getParam("REQUEST_METHOD"), QString("GET"));
+    QCOMPARE(request->getParam("k2"), QString("v2"));
 
     request->endRequest(0);
   }
@@ -212,11 +285,634 @@ private slots:
     request->endRequest(0);
   }
 
+  void outputCoalesced() {
+    QFCgiRequest *request = newRequest();
+    QVERIFY(request != 0);
+
+    request->getOut()->write("abc");
+    request->getOut()->write("def");
+    request->endRequest(0);
+
+    readUntilDisconnected();
+
+    verifyStream(this->so, 6, 1, QByteArray("abcdef"));
+    verifyStream(this->so, 6, 1, QByteArray());
+    verifyStream(this->so, 7, 1, QByteArray());
+    verifyEndRequest(this->so, 1, 0, 0);
+  }
+
+  void outputUnbuffered() {
+    QFCgiRequest *request = newRequest();
+    QVERIFY(request != 0);
+
+    request->setOutputPolicy(QFCgiRequest::Unbuffered);
+    request->getOut()->write("abc");
+    request->getOut()->write("def");
+    request->endRequest(0);
+
+    readUntilDisconnected();
+
+    verifyStream(this->so, 6, 1, QByteArray("abc"));
+    verifyStream(this->so, 6, 1, QByteArray("def"));
+    verifyStream(this->so, 6, 1, QByteArray());
+    verifyStream(this->so, 7, 1, QByteArray());
+    verifyEndRequest(this->so, 1, 0, 0);
+  }
+
+  void outputBigRecord() {
+    const QByteArray data(70000, 'x');
+    QFCgiRequest *request = newRequest();
+    QVERIFY(request != 0);
+
+    request->getOut()->write(data);
+    request->endRequest(0);
+
+    readUntilDisconnected();
+
+    verifyStream(this->so, 6, 1, data.left(65528));
+    verifyStream(this->so, 6, 1, data.mid(65528));
+    verifyStream(this->so, 6, 1, QByteArray());
+    verifyStream(this->so, 7, 1, QByteArray());
+    verifyEndRequest(this->so, 1, 0, 0);
+  }
+
+  void outputMultiplexed() {
+    const QByteArray data(2 * 65528, 'x');
+
+    QVERIFY(this->so->write(binaryBeginRequest(1, 1, 1)) > 0);
+    QVERIFY(this->so->write(binaryParam(1, QByteArray())) > 0);
+    QVERIFY(this->so->write(binaryBeginRequest(2, 1, 1)) > 0);
+    QVERIFY(this->so->write(binaryParam(2, QByteArray())) > 0);
+
+    QSignalSpy spy(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)));
+    QObject::connect(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)), loop, SLOT(quit()));
+    while (spy.count() < 2) {
+      loop->exec();
+    }
+
+    QFCgiRequest *big = qvariant_cast<QFCgiRequest*>(spy.at(0).at(0));
+    QFCgiRequest *small = qvariant_cast<QFCgiRequest*>(spy.at(1).at(0));
+
+    big->getOut()->write(data);
+    big->endRequest(0);
+    small->getOut()->write("small");
+    small->endRequest(0);
+
+    QObject::connect(this->so, SIGNAL(readyRead()), loop, SLOT(quit()));
+    while (this->so->bytesAvailable() < 65536 + 16) {
+      loop->exec();
+    }
+
+    // the small response is not queued behind the large one
+    verifyStream(this->so, 6, 1, data.left(65528));
+    verifyStream(this->so, 6, 2, "small");
+  }
+
+  void outputMultiplexedLater() {
+    const QByteArray data(16 * 1024 * 1024, 'x');
+    QFCgiRequest *big = newRequest(true);
+    QVERIFY(big != 0);
+
+    big->getOut()->write(data);
+    big->endRequest(0);
+
+    // the large response is scheduled, while it is alone on the connection
+    QObject::connect(this->so, SIGNAL(readyRead()), loop, SLOT(quit()));
+    loop->exec();
+
+    QSignalSpy spy(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)));
+    QObject::connect(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)), loop, SLOT(quit()));
+    QVERIFY(this->so->write(binaryBeginRequest(2, 1, 1)) > 0);
+    QVERIFY(this->so->write(binaryParam(2, QByteArray())) > 0);
+    while (spy.count() < 1) {
+      loop->exec();
+    }
+
+    QFCgiRequest *small = qvariant_cast<QFCgiRequest*>(spy.at(0).at(0));
+    small->getOut()->write("small");
+    small->endRequest(0);
+
+    qint64 bigOutput = 0;
+    qint64 bigOutputBefore = -1;
+    int ended = 0;
+
+    while (ended < 2) {
+      if (this->so->bytesAvailable() < 8) {
+        loop->exec();
+        continue;
+      }
+
+      const QByteArray header = this->so->peek(8);
+      int type = header[1] & 0xFF;
+      int requestId = ((header[2] & 0xFF) << 8) | (header[3] & 0xFF);
+      int contentLength = ((header[4] & 0xFF) << 8) | (header[5] & 0xFF);
+      int paddingLength = header[6] & 0xFF;
+
+      if (this->so->bytesAvailable() < 8 + contentLength + paddingLength) {
+        loop->exec();
+        continue;
+      }
+
+      this->so->read(8 + contentLength + paddingLength);
+
+      if (type == 3) {
+        ended++;
+      } else if (type == 6 && requestId == 1) {
+        bigOutput += contentLength;
+      } else if (type == 6 && requestId == 2 && bigOutputBefore == -1) {
+        bigOutputBefore = bigOutput;
+      }
+    }
+
+    // the small response is not queued behind the whole large one
+    QCOMPARE(bigOutput, qint64(data.size()));
+    QVERIFY(bigOutputBefore >= 0);
+    QVERIFY(bigOutputBefore < data.size());
+  }
+
+  void outputFile() {
+    QByteArray data(70000, 'x');
+    data.append("end");
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QVERIFY(file.write(data) == data.size());
+    QVERIFY(file.flush());
+
+    QFCgiRequest *request = newRequest();
+    QVERIFY(request != 0);
+
+    request->getOut()->write("abc");
+    QVERIFY(request->sendFile(file.handle(), 8));
+    QVERIFY(!request->sendFile(file.handle(), 0, data.size() + 1));
+    QVERIFY(!request->sendFile(QString("/nonexistent")));
+    request->endRequest(0);
+
+    readUntilDisconnected();
+
+    verifyStream(this->so, 6, 1, "abc");
+    verifyStream(this->so, 6, 1, data.mid(8, 65528));
+    verifyStream(this->so, 6, 1, data.mid(8 + 65528));
+    verifyStream(this->so, 6, 1, QByteArray());
+    verifyStream(this->so, 7, 1, QByteArray());
+    verifyEndRequest(this->so, 1, 0, 0);
+  }
+
+  void workerThreads() {
+    QFCgi fcgi;
+    WorkerHandler handler;
+
+    fcgi.setWorkerCount(2);
+    fcgi.configureListen(QHostAddress::LocalHost, 8001);
+    QObject::connect(&fcgi, SIGNAL(newRequest(QFCgiRequest*)),
+                     &handler, SLOT(onNewRequest(QFCgiRequest*)), Qt::DirectConnection);
+    fcgi.start();
+    QVERIFY(fcgi.isStarted());
+
+    workerRequest(8001);
+    workerRequest(8001);
+
+    // the snapshot is taken on the worker threads
+    QFCgiStats stats = fcgi.getStats();
+    QCOMPARE(stats.getStartedRequests(), (quint64)2);
+    QCOMPARE(stats.getCompletedRequests(), (quint64)2);
+  }
+
+  void drain() {
+    QTcpSocket idle;
+    idle.connectToHost("127.0.0.1", 8000);
+    QVERIFY(idle.waitForConnected());
+
+    // a keep-alive connection with a request in progress
+    QFCgiRequest *request = newRequest(true);
+    QVERIFY(request != 0);
+
+    QMetaObject::invokeMethod(this->fcgi, "drain");
+
+    // the idle connection is closed right away
+    QObject::connect(&idle, SIGNAL(disconnected()), loop, SLOT(quit()));
+
+    if (idle.state() != QAbstractSocket::UnconnectedState) {
+      loop->exec();
+    }
+
+    QCOMPARE(idle.state(), QAbstractSocket::UnconnectedState);
+    QCOMPARE(this->so->state(), QAbstractSocket::ConnectedState);
+
+    // the other one, after its last request
+    request->getOut()->write("done");
+    request->endRequest(0);
+
+    readUntilDisconnected();
+
+    verifyStream(this->so, 6, 1, QByteArray("done"));
+    verifyStream(this->so, 6, 1, QByteArray());
+    verifyStream(this->so, 7, 1, QByteArray());
+    verifyEndRequest(this->so, 1, 0, 0);
+
+    // no more connections are accepted
+    QTcpSocket late;
+    late.connectToHost("127.0.0.1", 8000);
+    QVERIFY(!late.waitForConnected(1000));
+  }
+
+  void workerReusePort() {
+    QFCgi fcgi;
+    WorkerHandler handler;
+
+    fcgi.setWorkerCount(2);
+    fcgi.configureListen(QHostAddress::LocalHost, 8002, QFCgi::ReusePortListener);
+    QObject::connect(&fcgi, SIGNAL(newRequest(QFCgiRequest*)),
+                     &handler, SLOT(onNewRequest(QFCgiRequest*)), Qt::DirectConnection);
+    fcgi.start();
+    QVERIFY(fcgi.isStarted());
+
+    workerRequest(8002);
+    workerRequest(8002);
+  }
+
+  void acceptBudget() {
+    QFCgi fcgi;
+    WorkerHandler handler;
+    QTcpSocket so[3];
+
+    fcgi.setAcceptBudget(1);
+    fcgi.configureListen(QHostAddress::LocalHost, 8003);
+    QObject::connect(&fcgi, SIGNAL(newRequest(QFCgiRequest*)),
+                     &handler, SLOT(onNewRequest(QFCgiRequest*)));
+    fcgi.start();
+    QVERIFY(fcgi.isStarted());
+
+    // queued up, before the event loop accepts them
+    for (int i = 0; i < 3; i++) {
+      so[i].connectToHost("127.0.0.1", 8003);
+      QVERIFY(so[i].waitForConnected());
+      so[i].write(binaryBeginRequest(1, 1, 0));
+      so[i].write(binaryParam(1, QByteArray()));
+      QObject::connect(&so[i], SIGNAL(disconnected()), loop, SLOT(quit()));
+    }
+
+    for (int i = 0; i < 3; i++) {
+      while (so[i].state() == QAbstractSocket::ConnectedState) {
+        loop->exec();
+      }
+
+      verifyStream(&so[i], 6, 1, "main");
+    }
+  }
+
+  void getValues() {
+    this->fcgi->setMaxConnections(10);
+
+    QByteArray names = encodeParam("FCGI_MAX_CONNS", "") +
+                       encodeParam("FCGI_MAX_REQS", "") +
+                       encodeParam("FCGI_MPXS_CONNS", "") +
+                       encodeParam("UNKNOWN", "");
+    QVERIFY(this->so->write(binaryRecord(1, 9, 0, names)) > 0);
+
+    QObject::connect(this->so, SIGNAL(readyRead()), loop, SLOT(quit()));
+    loop->exec();
+
+    // FCGI_MAX_REQS is unlimited and not reported
+    verifyStream(this->so, 10, 0, encodeParam("FCGI_MAX_CONNS", "10") + encodeParam("FCGI_MPXS_CONNS", "1"));
+  }
+
+  void unknownManagementType() {
+    QVERIFY(this->so->write(binaryRecord(1, 2, 0, QByteArray())) > 0);
+
+    QObject::connect(this->so, SIGNAL(readyRead()), loop, SLOT(quit()));
+    loop->exec();
+
+    verifyStream(this->so, 11, 0, QByteArray("\x02\0\0\0\0\0\0\0", 8));
+  }
+
+  void unknownManagementTypeAboveKnown() {
+    QVERIFY(this->so->write(binaryRecord(1, 12, 0, QByteArray())) > 0);
+
+    QObject::connect(this->so, SIGNAL(readyRead()), loop, SLOT(quit()));
+    loop->exec();
+
+    // the connection survives the unknown type
+    verifyStream(this->so, 11, 0, QByteArray("\x0c\0\0\0\0\0\0\0", 8));
+    QCOMPARE(this->so->state(), QAbstractSocket::ConnectedState);
+  }
+
+  void overloadedMaxConnections() {
+    this->fcgi->setMaxConnections(1);
+
+    QTcpSocket so;
+    so.connectToHost("127.0.0.1", 8000);
+    QVERIFY(so.waitForConnected());
+
+    // only the connection of init() is admitted
+    QObject::connect(&so, SIGNAL(disconnected()), loop, SLOT(quit()));
+    loop->exec();
+  }
+
+  void overloadedMaxRequests() {
+    this->fcgi->setMaxRequests(1);
+
+    QFCgiRequest *request = newRequest();
+    QVERIFY(request != 0);
+
+    // the remaining records of the rejected request are skipped
+    QVERIFY(this->so->write(binaryBeginRequest(2, 1, 1)) > 0);
+    QVERIFY(this->so->write(binaryParam(2, QByteArray())) > 0);
+    QVERIFY(this->so->write(binaryStdin(2, QByteArray())) > 0);
+
+    QObject::connect(this->so, SIGNAL(readyRead()), loop, SLOT(quit()));
+    while (this->so->bytesAvailable() < 16) {
+      loop->exec();
+    }
+
+    verifyEndRequest(this->so, 2, 0, 2);
+
+    request->endRequest(0);
+  }
+
+  void abortRequest() {
+    QFCgiRequest *request = newRequest();
+    QVERIFY(request != 0);
+
+    QSignalSpy spy(request, SIGNAL(aborted()));
+    QObject::connect(request, SIGNAL(aborted()), loop, SLOT(quit()));
+
+    QVERIFY(this->so->write(binaryRecord(1, 2, 1, QByteArray())) > 0);
+    loop->exec();
+
+    QCOMPARE(spy.count(), 1);
+    QVERIFY(request->isAborted());
+
+    // output of the aborted request is discarded
+    request->getOut()->write("discarded");
+    request->endRequest(1);
+
+    readUntilDisconnected();
+
+    verifyStream(this->so, 6, 1, QByteArray());
+    verifyStream(this->so, 7, 1, QByteArray());
+    verifyEndRequest(this->so, 1, 0, 0);
+    QCOMPARE(this->so->bytesAvailable(), (qint64)0);
+  }
+
+  void abortRequestClosesLater() {
+    QFCgiRequest *request = newRequest();
+    QVERIFY(request != 0);
+
+    QObject::connect(request, SIGNAL(aborted()), loop, SLOT(quit()));
+    QVERIFY(this->so->write(binaryRecord(1, 2, 1, QByteArray())) > 0);
+    loop->exec();
+
+    QObject::connect(this->so, SIGNAL(readyRead()), loop, SLOT(quit()));
+    while (this->so->bytesAvailable() < 32) {
+      loop->exec();
+    }
+
+    // the connection and its request survive the event loop
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+    QCOMPARE(this->so->state(), QAbstractSocket::ConnectedState);
+    QVERIFY(request->isAborted());
+
+    request->endRequest(0);
+
+    readUntilDisconnected();
+
+    verifyStream(this->so, 6, 1, QByteArray());
+    verifyStream(this->so, 7, 1, QByteArray());
+    verifyEndRequest(this->so, 1, 0, 0);
+    QCOMPARE(this->so->bytesAvailable(), (qint64)0);
+  }
+
+  void abortRequestNotReused() {
+    QFCgiRequest *request = newRequest(true);
+    QVERIFY(request != 0);
+
+    QObject::connect(request, SIGNAL(aborted()), loop, SLOT(quit()));
+    QVERIFY(this->so->write(binaryRecord(1, 2, 1, QByteArray())) > 0);
+    loop->exec();
+
+    QObject::connect(this->so, SIGNAL(readyRead()), loop, SLOT(quit()));
+    while (this->so->bytesAvailable() < 32) {
+      loop->exec();
+    }
+
+    verifyStream(this->so, 6, 1, QByteArray());
+    verifyStream(this->so, 7, 1, QByteArray());
+    verifyEndRequest(this->so, 1, 0, 0);
+
+    // the web server reuses the request-id
+    QSignalSpy spy(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)));
+    QObject::connect(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)), loop, SLOT(quit()));
+    QVERIFY(this->so->write(binaryBeginRequest(1, 1, 1)) > 0);
+    QVERIFY(this->so->write(binaryParam(1, QByteArray())) > 0);
+    while (spy.count() < 1) {
+      loop->exec();
+    }
+
+    QFCgiRequest *next = qvariant_cast<QFCgiRequest*>(spy.at(0).at(0));
+    QVERIFY(next != request);
+
+    // the application is not done with the aborted request yet
+    request->getOut()->write("stale");
+    request->flush();
+    request->endRequest(0);
+
+    next->getOut()->write("next");
+    next->endRequest(0);
+
+    while (this->so->bytesAvailable() < 48) {
+      loop->exec();
+    }
+
+    verifyStream(this->so, 6, 1, QByteArray("next"));
+    verifyStream(this->so, 6, 1, QByteArray());
+    verifyStream(this->so, 7, 1, QByteArray());
+    verifyEndRequest(this->so, 1, 0, 0);
+    QCOMPARE(this->so->bytesAvailable(), (qint64)0);
+  }
+
+  void stats() {
+    QFCgiRequest *request = newRequest();
+    QVERIFY(request != 0);
+
+    QFCgiStats stats = this->fcgi->getStats();
+    QCOMPARE(stats.getAcceptedConnections(), (quint64)1);
+    QCOMPARE(stats.getStartedRequests(), (quint64)1);
+    QCOMPARE(stats.getActiveRequests(), (quint64)1);
+    QCOMPARE(stats.getRecordCount(1), (quint64)1);
+    QCOMPARE(stats.getRecordCount(4), (quint64)1);
+    QCOMPARE(stats.getLatencyCount(QFCgiStats::ParamsLatency), (quint64)1);
+
+    request->endRequest(0);
+
+    stats = this->fcgi->getStats();
+    QCOMPARE(stats.getCompletedRequests(), (quint64)1);
+    QCOMPARE(stats.getActiveRequests(), (quint64)0);
+    QCOMPARE(stats.getLatencyCount(QFCgiStats::ResponseLatency), (quint64)1);
+    QCOMPARE(stats.getLatencyCount(QFCgiStats::TotalLatency), (quint64)1);
+    QVERIFY(stats.getBytesIn() > 0);
+  }
+
+  void metrics() {
+    QFCgi fcgi;
+    fcgi.configureListen(QHostAddress::LocalHost, 8004);
+    fcgi.configureMetrics(QHostAddress::LocalHost, 8005);
+    fcgi.start();
+    QVERIFY(fcgi.isStarted());
+
+    QTcpSocket so;
+    so.connectToHost("127.0.0.1", 8005);
+    QVERIFY(so.waitForConnected());
+    so.write("GET /metrics HTTP/1.0\r\n\r\n");
+
+    QObject::connect(&so, SIGNAL(disconnected()), loop, SLOT(quit()));
+    loop->exec();
+
+    QByteArray response = so.readAll();
+    QVERIFY(response.startsWith("HTTP/1.0 200 OK\r\n"));
+    QVERIFY(response.contains("qfcgi_connections_accepted_total{worker=\"0\"} 0\n"));
+    QVERIFY(response.contains("qfcgi_request_duration_seconds_count{worker=\"0\",phase=\"total\"} 0\n"));
+  }
+
+  void metricsStatsIntervalOff() {
+    QFCgi fcgi;
+    fcgi.configureListen(QHostAddress::LocalHost, 8006);
+    fcgi.configureMetrics(QHostAddress::LocalHost, 8007);
+    fcgi.setStatsInterval(0);
+    fcgi.start();
+    QVERIFY(fcgi.isStarted());
+
+    // the admin socket does not depend on the statsUpdated() timer
+    QTcpSocket so;
+    so.connectToHost("127.0.0.1", 8007);
+    QVERIFY(so.waitForConnected());
+    so.write("GET /metrics HTTP/1.0\r\n\r\n");
+
+    QObject::connect(&so, SIGNAL(disconnected()), loop, SLOT(quit()));
+    loop->exec();
+
+    QVERIFY(so.readAll().startsWith("HTTP/1.0 200 OK\r\n"));
+  }
+
+  void stdinRead() {
+    QFCgiRequest *request = newRequest();
+    QVERIFY(request != 0);
+
+    QIODevice *in = request->getIn();
+    QObject::connect(in, SIGNAL(readChannelFinished()), loop, SLOT(quit()));
+
+    QVERIFY(this->so->write(binaryStdin(1, "12345678")) > 0);
+    QVERIFY(this->so->write(binaryStdin(1, "abcdefgh")) > 0);
+    QVERIFY(this->so->write(binaryStdin(1, QByteArray())) > 0);
+    loop->exec();
+
+    QCOMPARE(in->readAll(), QByteArray("12345678abcdefgh"));
+    QVERIFY(in->atEnd());
+
+    request->endRequest(0);
+  }
+
+  void stdinRequestInputLimit() {
+    this->fcgi->setRequestInputLimit(4);
+
+    QFCgiRequest *request = newRequest();
+    QVERIFY(request != 0);
+
+    QIODevice *in = request->getIn();
+    QObject::connect(in, SIGNAL(readyRead()), loop, SLOT(quit()));
+
+    QVERIFY(this->so->write(binaryStdin(1, "12345678")) > 0);
+    QVERIFY(this->so->write(binaryStdin(1, "abcdefgh")) > 0);
+    QVERIFY(this->so->write(binaryStdin(1, QByteArray())) > 0);
+    loop->exec();
+
+    // the second record waits, until the first one is consumed
+    QCOMPARE(in->bytesAvailable(), (qint64)8);
+    QCOMPARE(in->read(8), QByteArray("12345678"));
+
+    loop->exec();
+    QCOMPARE(in->readAll(), QByteArray("abcdefgh"));
+    QVERIFY(in->atEnd());
+
+    request->endRequest(0);
+  }
+
+  void stdinRequestInputLimitKeepsConnection() {
+    this->fcgi->setRequestInputLimit(4);
+
+    QFCgiRequest *request = newRequest();
+    QVERIFY(request != 0);
+
+    QIODevice *in = request->getIn();
+    QObject::connect(in, SIGNAL(readyRead()), loop, SLOT(quit()));
+    QObject::connect(in, SIGNAL(readChannelFinished()), loop, SLOT(quit()));
+
+    QVERIFY(this->so->write(binaryStdin(1, "12345678")) > 0);
+    QVERIFY(this->so->write(binaryStdin(1, "abcdefgh")) > 0);
+    QVERIFY(this->so->write(binaryStdin(1, "ABCDEFGH")) > 0);
+    QVERIFY(this->so->write(binaryStdin(1, QByteArray())) > 0);
+
+    // the limit is hit with every record, the handler reads while it arrives
+    QByteArray body;
+
+    for (int i = 0; i < 10 && !in->atEnd(); i++) {
+      loop->exec();
+      body.append(in->readAll());
+    }
+
+    QCOMPARE(body, QByteArray("12345678abcdefghABCDEFGH"));
+    QVERIFY(in->atEnd());
+
+    request->getOut()->write("done");
+    request->endRequest(0);
+
+    readUntilDisconnected();
+
+    verifyStream(this->so, 6, 1, QByteArray("done"));
+    verifyStream(this->so, 6, 1, QByteArray());
+    verifyStream(this->so, 7, 1, QByteArray());
+    verifyEndRequest(this->so, 1, 0, 0);
+  }
+
 private:
   QFCgi *fcgi;
   QTcpSocket *so;
   QEventLoop *loop;
 
+  QFCgiRequest* newRequest(bool keepConnection = false) {
+    this->so->write(binaryBeginRequest(1, 1, keepConnection));
+    this->so->write(binaryParam(1, QByteArray()));
+
+    QSignalSpy spy(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)));
+    QObject::connect(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)), loop, SLOT(quit()));
+    loop->exec();
+    QObject::disconnect(this->fcgi, SIGNAL(newRequest(QFCgiRequest*)), loop, SLOT(quit()));
+
+    return (spy.count() == 1) ? qvariant_cast<QFCgiRequest*>(spy.at(0).at(0)) : 0;
+  }
+
+  void workerRequest(quint16 port) {
+    QTcpSocket so;
+    so.connectToHost("127.0.0.1", port);
+    QVERIFY(so.waitForConnected());
+
+    so.write(binaryBeginRequest(1, 1, 0));
+    so.write(binaryParam(1, QByteArray()));
+
+    QObject::connect(&so, SIGNAL(disconnected()), loop, SLOT(quit()));
+    loop->exec();
+
+    verifyStream(&so, 6, 1, "worker");
+    verifyStream(&so, 6, 1, QByteArray());
+    verifyStream(&so, 7, 1, QByteArray());
+    verifyEndRequest(&so, 1, 0, 0);
+  }
+
+  void readUntilDisconnected() {
+    QObject::connect(this->so, SIGNAL(disconnected()), loop, SLOT(quit()));
+    loop->exec();
+  }
+
   QString bigString(const QString &in, int count) {
     QByteArray ba;
 
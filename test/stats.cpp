@@ -0,0 +1,53 @@
+/**
+ * This file is part of QFCgi.
+ *
+ * QFCgi is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * QFCgi is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QFCgi. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtTest/QtTest>
+
+#include "../src/qfcgi/stats.h"
+
+class StatsTest: public QObject {
+  Q_OBJECT
+
+private slots:
+  void empty() {
+    QFCgiStats stats;
+
+    QCOMPARE(stats.getAcceptedConnections(), (quint64)0);
+    QCOMPARE(stats.getActiveRequests(), (quint64)0);
+    QCOMPARE(stats.getRecordCount(1), (quint64)0);
+    QCOMPARE(stats.getRecordCount(99), (quint64)0);
+    QCOMPARE(stats.getLatencyCount(QFCgiStats::TotalLatency), (quint64)0);
+    QCOMPARE(stats.getLatencyPercentile(QFCgiStats::TotalLatency, 99.0), (qint64)0);
+  }
+
+  void bucketUpperBound() {
+    QCOMPARE(QFCgiStats::getBucketUpperBound(0), (qint64)0);
+    QCOMPARE(QFCgiStats::getBucketUpperBound(3), (qint64)3);
+    QCOMPARE(QFCgiStats::getBucketUpperBound(4), (qint64)4);
+    QCOMPARE(QFCgiStats::getBucketUpperBound(7), (qint64)7);
+    QCOMPARE(QFCgiStats::getBucketUpperBound(8), (qint64)9);
+    QCOMPARE(QFCgiStats::getBucketUpperBound(11), (qint64)15);
+    QCOMPARE(QFCgiStats::getBucketUpperBound(12), (qint64)19);
+
+    for (int i = 1; i < QFCgiStats::NUM_BUCKETS; i++) {
+      QVERIFY(QFCgiStats::getBucketUpperBound(i) > QFCgiStats::getBucketUpperBound(i - 1));
+    }
+  }
+};
+
+QTEST_MAIN(StatsTest)
+#include "stats.moc"
@@ -17,6 +17,8 @@
 
 #include <QtTest/QtTest>
 
+#include <unistd.h>
+
 #include "test_stream.h"
 #include "../src/qfcgi/stream.h"
 
@@ -66,20 +68,28 @@ private slots:
 
   void append() {
     QVERIFY(stream->append(QByteArray("123")));
-    QCOMPARE(stream->getBuffer().size(), 3);
-    QVERIFY(memcmp(stream->getBuffer().data(), "123", 3) == 0);
+    QCOMPARE(stream->bytesAvailable(), (qint64)3);
+    QCOMPARE(stream->peek(3), QByteArray("123"));
+    QCOMPARE(stream->getBuffer().size(), 0);
   }
 
   void appendNotOpen() {
     stream->close();
     QVERIFY(!stream->append(QByteArray("123")));
-    QCOMPARE(stream->getBuffer().size(), 0);
+    QCOMPARE(stream->bytesAvailable(), (qint64)0);
   }
 
   void appendAtEof() {
     QVERIFY(stream->setEof());
     QVERIFY(!stream->append(QByteArray("123")));
-    QCOMPARE(stream->getBuffer().size(), 0);
+    QCOMPARE(stream->bytesAvailable(), (qint64)0);
+  }
+
+  void appendRawData() {
+    QByteArray raw("123");
+    QVERIFY(stream->append(QByteArray::fromRawData(raw.constData(), raw.size())));
+    raw[0] = 'x';
+    QCOMPARE(stream->read(3), QByteArray("123"));
   }
 
   void setEof() {
@@ -126,6 +136,118 @@ private slots:
     QVERIFY(memcmp(data, "123", 3) == 0);
   }
 
+  void readChunks() {
+    char data[16] = { 0 };
+    QVERIFY(stream->append(QByteArray("123")));
+    QVERIFY(stream->append(QByteArray("45")));
+    QVERIFY(stream->append(QByteArray("6789")));
+
+    QVERIFY(stream->read(data, 2) == 2);
+    QVERIFY(memcmp(data, "12", 2) == 0);
+    QVERIFY(stream->bytesAvailable() == 7);
+
+    QVERIFY(stream->read(data, sizeof(data)) == 7);
+    QVERIFY(memcmp(data, "3456789", 7) == 0);
+    QVERIFY(stream->bytesAvailable() == 0);
+  }
+
+  void readWhileReceiving() {
+    QByteArray data;
+
+    // every chunk fills a block of the arena
+    QVERIFY(stream->append(QByteArray(65536, 'a')));
+
+    for (char c = 'b'; c < 'z'; c++) {
+      QVERIFY(stream->append(QByteArray(65536, c)));
+
+      data = stream->read(65536);
+      QCOMPARE(data, QByteArray(65536, c - 1));
+    }
+
+    QCOMPARE(stream->bytesInMemory(), (qint64)65536);
+    QCOMPARE(stream->read(65536), QByteArray(65536, 'y'));
+    QVERIFY(stream->bytesAvailable() == 0);
+  }
+
+  void bytesReadSignal() {
+    char data[16] = { 0 };
+    QSignalSpy spy(stream, SIGNAL(bytesRead(qint64)));
+
+    QVERIFY(stream->append(QByteArray("123")));
+    QVERIFY(stream->read(data, sizeof(data)) == 3);
+    QCOMPARE(spy.count(), 1);
+  }
+
+  void closeDropsData() {
+    QVERIFY(stream->append(QByteArray("123")));
+    stream->close();
+    QVERIFY(stream->open(QIODevice::ReadWrite));
+    QVERIFY(stream->bytesAvailable() == 0);
+  }
+
+  void spillBelowThreshold() {
+    stream->setSpillThreshold(8);
+    QVERIFY(stream->append(QByteArray("12345678")));
+    QCOMPARE(stream->fileDescriptor(), -1);
+    QVERIFY(stream->bytesInMemory() == 8);
+  }
+
+  void spillAboveThreshold() {
+    char data[16] = { 0 };
+
+    stream->setSpillThreshold(4);
+    QVERIFY(stream->append(QByteArray("123")));
+    QVERIFY(stream->read(data, 1) == 1);
+    QVERIFY(stream->append(QByteArray("456")));
+    QVERIFY(stream->fileDescriptor() != -1);
+    QVERIFY(stream->bytesAvailable() == 5);
+    QVERIFY(stream->bytesInMemory() == 0);
+
+    QVERIFY(stream->read(data, 2) == 2);
+    QVERIFY(memcmp(data, "23", 2) == 0);
+    QVERIFY(stream->append(QByteArray("789")));
+    QVERIFY(stream->read(data, sizeof(data)) == 6);
+    QVERIFY(memcmp(data, "456789", 6) == 0);
+  }
+
+  void spillMapped() {
+    char data[16] = { 0 };
+
+    stream->setSpillThreshold(4);
+    QVERIFY(stream->append(QByteArray("123456")));
+    QVERIFY(stream->append(QByteArray("789")));
+    QVERIFY(stream->setEof());
+    QVERIFY(stream->read(data, 4) == 4);
+    QVERIFY(memcmp(data, "1234", 4) == 0);
+    QVERIFY(stream->read(data, sizeof(data)) == 5);
+    QVERIFY(memcmp(data, "56789", 5) == 0);
+    QVERIFY(stream->atEnd());
+
+    int fd = stream->fileDescriptor();
+    QVERIFY(fd != -1);
+    QVERIFY(pread(fd, data, sizeof(data), 0) == 9);
+    QVERIFY(memcmp(data, "123456789", 9) == 0);
+
+    stream->close();
+    QCOMPARE(stream->fileDescriptor(), -1);
+  }
+
+  void spillUnbuffered() {
+    char data[16] = { 0 };
+
+    // the file starts with the first byte not read by the application
+    stream->reopen(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    stream->setSpillThreshold(4);
+    QVERIFY(stream->append(QByteArray("123")));
+    QVERIFY(stream->read(data, 1) == 1);
+    QVERIFY(stream->append(QByteArray("456")));
+
+    int fd = stream->fileDescriptor();
+    QVERIFY(fd != -1);
+    QVERIFY(pread(fd, data, sizeof(data), 0) == 5);
+    QVERIFY(memcmp(data, "23456", 5) == 0);
+  }
+
   void readNoData() {
     char data[16] = { 0 };
     QVERIFY(stream->read(data, sizeof(data)) == 0);